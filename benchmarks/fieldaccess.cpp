@@ -0,0 +1,116 @@
+/*
+ * fieldaccess.cpp
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Tight read loop over the fields of a model, through the typed accessors
+ * and through QField::data(). No database is needed, the values are set in
+ * memory.
+ */
+
+#include "qmodel.h"
+
+#include <QElapsedTimer>
+#include <QDateTime>
+
+#include <stdio.h>
+
+static const int Iterations = 10000000;
+
+struct Author : public QModel
+{
+    Author() : QModel("bench_author")
+    {
+        name = stringField("name");
+
+        init();
+    }
+
+    QStringField name;
+};
+
+struct Book : public QModel
+{
+    Book() : QModel("bench_book")
+    {
+        pages = intField("pages");
+        price = doubleField("price");
+        title = stringField("title");
+        published = dateTimeField("published");
+        author = foreignKey<Author>("author");
+
+        init();
+    }
+
+    QIntField pages;
+    QDoubleField price;
+    QStringField title;
+    QDateTimeField published;
+    QForeignKey<Author> author;
+};
+
+static void report(const char *name, qint64 nsecs)
+{
+    printf("%-24s %8.2f ns/row\n", name, double(nsecs) / Iterations);
+}
+
+int main()
+{
+    Book book;
+    QElapsedTimer timer;
+    qlonglong checksum = 0;
+
+    book.pages = 320;
+    book.price = 12.5;
+    book.title = QString("Title");
+    book.published = QDateTime::currentDateTime();
+    book.author.setId(42);
+
+    timer.start();
+
+    for (int i=0; i<Iterations; ++i)
+    {
+        checksum += book.pages.value();
+        checksum += qlonglong(book.price.value());
+        checksum += book.title.value().size();
+        checksum += book.published.value().isValid();
+        checksum += book.author.id();
+    }
+
+    report("typed accessors", timer.nsecsElapsed());
+    timer.restart();
+
+    for (int i=0; i<Iterations; ++i)
+    {
+        checksum += book.pages.data().toInt();
+        checksum += qlonglong(book.price.data().toDouble());
+        checksum += book.title.data().toString().size();
+        checksum += book.published.data().toDateTime().isValid();
+        checksum += book.author.data().toLongLong();
+    }
+
+    report("QField::data()", timer.nsecsElapsed());
+
+    // Keep the loops from being optimized out
+    printf("checksum %lld\n", checksum);
+
+    return 0;
+}
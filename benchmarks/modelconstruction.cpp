@@ -0,0 +1,115 @@
+/*
+ * modelconstruction.cpp
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Construction and destruction of models, the first instance registers the
+ * schema of its type and the next ones share it. No database is needed.
+ */
+
+#include "qmodel.h"
+
+#include <QElapsedTimer>
+
+#include <stdio.h>
+
+static const int Iterations = 1000000;
+
+struct Author : public QModel
+{
+    Author() : QModel("bench_author")
+    {
+        name = stringField("name");
+
+        init();
+    }
+
+    QStringField name;
+};
+
+struct Book : public QModel
+{
+    Book() : QModel("bench_book")
+    {
+        pages = intField("pages");
+        price = doubleField("price");
+        title = stringField("title");
+        published = dateTimeField("published");
+        author = foreignKey<Author>("author");
+
+        init();
+    }
+
+    QIntField pages;
+    QDoubleField price;
+    QStringField title;
+    QDateTimeField published;
+    QForeignKey<Author> author;
+};
+
+static void report(const char *name, qint64 nsecs)
+{
+    printf("%-24s %8.2f ns/model\n", name, double(nsecs) / Iterations);
+}
+
+int main()
+{
+    QElapsedTimer timer;
+    qlonglong checksum = 0;
+
+    timer.start();
+
+    {
+        // Registers the schema
+        Book book;
+
+        checksum += book.tableName().size();
+    }
+
+    report("first instance", timer.nsecsElapsed() * Iterations);
+    timer.restart();
+
+    for (int i=0; i<Iterations; ++i)
+    {
+        Book book;
+
+        checksum += book.tableName().size();
+    }
+
+    report("next instances", timer.nsecsElapsed());
+    timer.restart();
+
+    for (int i=0; i<Iterations; ++i)
+    {
+        Book *book = new Book;
+
+        checksum += book->tableName().size();
+        delete book;
+    }
+
+    report("next instances, heap", timer.nsecsElapsed());
+
+    // Keep the loops from being optimized out
+    printf("checksum %lld\n", checksum);
+
+    return 0;
+}
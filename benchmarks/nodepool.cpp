@@ -0,0 +1,86 @@
+/*
+ * nodepool.cpp
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Allocation of the nodes of a filter through the node pool and through
+ * operator new. Every round builds a tree of the sizes of the QWhere nodes
+ * of a small filter, and destroys it.
+ */
+
+#include "qnodepool_p.h"
+
+#include <QElapsedTimer>
+
+#include <new>
+#include <stdio.h>
+
+static const int Iterations = 10000000;
+static const int NodeCount = 7;
+static const size_t NodeSizes[NodeCount] = { 48, 40, 56, 40, 48, 32, 64 };
+
+static void report(const char *name, qint64 nsecs)
+{
+    printf("%-24s %8.2f ns/filter, %8.0f filters/s\n", name,
+           double(nsecs) / Iterations, Iterations / (double(nsecs) / 1e9));
+}
+
+int main()
+{
+    void *nodes[NodeCount];
+    QElapsedTimer timer;
+    quintptr checksum = 0;
+
+    timer.start();
+
+    for (int i=0; i<Iterations; ++i)
+    {
+        for (int j=0; j<NodeCount; ++j)
+            nodes[j] = QNodePool::allocate(NodeSizes[j]);
+
+        checksum += (quintptr)nodes[i % NodeCount];
+
+        for (int j=NodeCount - 1; j>=0; --j)
+            QNodePool::release(nodes[j], NodeSizes[j]);
+    }
+
+    report("node pool", timer.nsecsElapsed());
+    timer.restart();
+
+    for (int i=0; i<Iterations; ++i)
+    {
+        for (int j=0; j<NodeCount; ++j)
+            nodes[j] = ::operator new(NodeSizes[j]);
+
+        checksum += (quintptr)nodes[i % NodeCount];
+
+        for (int j=NodeCount - 1; j>=0; --j)
+            ::operator delete(nodes[j]);
+    }
+
+    report("operator new", timer.nsecsElapsed());
+
+    // Keep the loops from being optimized out
+    printf("checksum %llu\n", (unsigned long long)(checksum & 0xffff));
+
+    return 0;
+}
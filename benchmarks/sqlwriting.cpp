@@ -0,0 +1,130 @@
+/*
+ * sqlwriting.cpp
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Rendering of filters and of whole SELECT statements, through the SQL
+ * writer. The statements are built but not run, on an in-memory SQLite
+ * database whose driver escapes the names.
+ */
+
+#include "qmodel.h"
+#include "qqueryset.h"
+#include "qf.h"
+
+#include <QCoreApplication>
+#include <QSqlDatabase>
+#include <QSqlDriver>
+#include <QElapsedTimer>
+
+#include <stdio.h>
+
+static const int Iterations = 100000;
+
+struct Author : public QModel
+{
+    Author() : QModel("bench_author")
+    {
+        name = stringField("name");
+
+        init();
+    }
+
+    QStringField name;
+};
+
+struct Book : public QModel
+{
+    Book() : QModel("bench_book")
+    {
+        pages = intField("pages");
+        price = doubleField("price");
+        title = stringField("title");
+        published = dateTimeField("published");
+        author = foreignKey<Author>("author");
+
+        init();
+    }
+
+    QIntField pages;
+    QDoubleField price;
+    QStringField title;
+    QDateTimeField published;
+    QForeignKey<Author> author;
+};
+
+static void report(const char *name, qint64 nsecs)
+{
+    printf("%-24s %8.2f us/statement, %8.0f statements/s\n", name,
+           double(nsecs) / Iterations / 1000, Iterations / (double(nsecs) / 1e9));
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
+
+    db.setDatabaseName(":memory:");
+
+    if (!db.open())
+    {
+        printf("Cannot open the SQLite database\n");
+        return 1;
+    }
+
+    Book book;
+    QElapsedTimer timer;
+    qlonglong checksum = 0;
+
+    QWhere where = (QF(book.price) > 3.0 && QF(book.title) == QString("Title")) ||
+                   (QF(book.pages) < 100 && QF(book.author->name) == QString("Name"));
+
+    timer.start();
+
+    for (int i=0; i<Iterations; ++i)
+    {
+        QVariantList values;
+
+        checksum += where.sql(db.driver()).size();
+        where.bindValues(values);
+        checksum += values.count();
+    }
+
+    report("filter", timer.nsecsElapsed());
+    timer.restart();
+
+    for (int i=0; i<Iterations; ++i)
+    {
+        QQuerySet set(&book);
+
+        set.addFilter(where);
+        set.addOrderBy(book.published, false);
+        checksum += set.sql().size();
+    }
+
+    report("SELECT with a join", timer.nsecsElapsed());
+
+    // Keep the loops from being optimized out
+    printf("checksum %lld\n", checksum);
+
+    return 0;
+}
@@ -21,38 +21,22 @@
  */
 
 #include "qassign.h"
+#include "qassign_p.h"
 #include "qfield.h"
 #include "qf.h"
+#include "qsqlwriter_p.h"
+#include "qnodepool_p.h"
 
 #include <QtDebug>
 #include <QSqlDriver>
 
-class QAssignPrivate
-{
-    public:
-        QAssignPrivate();
-        virtual ~QAssignPrivate();
-
-        QString fieldName(const QField &field, QSqlDriver *driver) const;
-
-        void ref();
-        bool deref();
-
-        virtual QString sql(QSqlDriver *driver) const = 0;
-        virtual void bindValues(QVariantList &values) const = 0;
-
-    private:
-        unsigned int _refcount;
-};
-
 class QFAssignPrivate : public QAssignPrivate
 {
     public:
         QFAssignPrivate(const QField &f);
         ~QFAssignPrivate();
 
-        QString sql(QSqlDriver *driver) const;
-        void bindValues(QVariantList &values) const;
+        void writeSql(QSqlWriter &writer) const;
 
     private:
         QField _f;
@@ -64,8 +48,7 @@ class QIAssignPrivate : public QAssignPrivate
         QIAssignPrivate(const QVariant &value);
         ~QIAssignPrivate();
 
-        QString sql(QSqlDriver *driver) const;
-        void bindValues(QVariantList &values) const;
+        void writeSql(QSqlWriter &writer) const;
 
     private:
         QVariant _value;
@@ -77,8 +60,7 @@ class QOpAssignPrivate : public QAssignPrivate
         QOpAssignPrivate(const QAssign &left, const QAssign &right, QAssign::Operation op);
         ~QOpAssignPrivate();
 
-        QString sql(QSqlDriver *driver) const;
-        void bindValues(QVariantList &values) const;
+        void writeSql(QSqlWriter &writer) const;
 
     private:
         QAssign _left;
@@ -94,9 +76,15 @@ QAssignPrivate::~QAssignPrivate()
 {
 }
 
-QString QAssignPrivate::fieldName(const QField& field, QSqlDriver *driver) const
+void *QAssignPrivate::operator new(size_t size)
 {
-    return driver->escapeIdentifier(field.fieldName(), QSqlDriver::FieldName);
+    // Nodes are small and short-lived, take them from the node pool
+    return QNodePool::allocate(size);
+}
+
+void QAssignPrivate::operator delete(void *ptr, size_t size)
+{
+    QNodePool::release(ptr, size);
 }
 
 void QAssignPrivate::ref()
@@ -176,12 +164,24 @@ QString QAssign::operationStr(QAssign::Operation op)
 
 void QAssign::bindValues(QVariantList& values) const
 {
-    d->bindValues(values);
+    QSqlWriter writer(NULL);
+
+    d->writeSql(writer);
+    values += writer.values();
 }
 
 QString QAssign::sql(QSqlDriver *driver) const
 {
-    return d->sql(driver);
+    QSqlWriter writer(driver);
+
+    d->writeSql(writer);
+
+    return writer.sql();
+}
+
+void QAssign::writeSql(QSqlWriter &writer) const
+{
+    d->writeSql(writer);
 }
 
 QAssign QAssign::operator+(const QAssign& other)
@@ -215,15 +215,9 @@ QFAssignPrivate::~QFAssignPrivate()
 {
 }
 
-void QFAssignPrivate::bindValues(QVariantList& values) const
-{
-    (void) values;
-    return;
-}
-
-QString QFAssignPrivate::sql(QSqlDriver *driver) const
+void QFAssignPrivate::writeSql(QSqlWriter &writer) const
 {
-    return fieldName(_f, driver);
+    writer.appendFieldName(_f);
 }
 
 /*
@@ -237,16 +231,9 @@ QIAssignPrivate::~QIAssignPrivate()
 {
 }
 
-void QIAssignPrivate::bindValues(QVariantList& values) const
+void QIAssignPrivate::writeSql(QSqlWriter &writer) const
 {
-    values.append(_value);
-}
-
-QString QIAssignPrivate::sql(QSqlDriver *driver) const
-{
-    (void) driver;
-
-    return QString("?");
+    writer.appendValue(_value);
 }
 
 /*
@@ -261,18 +248,13 @@ QOpAssignPrivate::~QOpAssignPrivate()
 {
 }
 
-QString QOpAssignPrivate::sql(QSqlDriver *driver) const
-{
-    return QString("(%0) %1 (%2)")
-        .arg(_left.sql(driver))
-        .arg(QAssign::operationStr(_op))
-        .arg(_right.sql(driver));
-}
-
-void QOpAssignPrivate::bindValues(QVariantList &values) const
+void QOpAssignPrivate::writeSql(QSqlWriter &writer) const
 {
-    _left.bindValues(values);
-    _right.bindValues(values);
+    writer << '(';
+    _left.writeSql(writer);
+    writer << ") " << QAssign::operationStr(_op) << " (";
+    _right.writeSql(writer);
+    writer << ')';
 }
 
 QOpAssign::QOpAssign(const QAssign& left, const QAssign& right, QAssign::Operation op)
@@ -28,6 +28,7 @@
 class QF;
 class QAssignPrivate;
 class QSqlDriver;
+class QSqlWriter;
 
 class QAssign
 {
@@ -78,6 +79,7 @@ class QAssign
     public:
         QString sql(QSqlDriver *driver) const;
         void bindValues(QVariantList &values) const;
+        void writeSql(QSqlWriter &writer) const;
 
     private:
         QAssignPrivate *d;
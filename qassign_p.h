@@ -0,0 +1,50 @@
+/*
+ * qassign_p.h
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef __QASSIGN_P_H__
+#define __QASSIGN_P_H__
+
+#include <cstddef>
+
+#include "qassign.h"
+
+class QSqlWriter;
+
+class QAssignPrivate
+{
+    public:
+        QAssignPrivate();
+        virtual ~QAssignPrivate();
+
+        static void *operator new(size_t size);
+        static void operator delete(void *ptr, size_t size);
+
+        void ref();
+        bool deref();
+
+        virtual void writeSql(QSqlWriter &writer) const = 0;
+
+    private:
+        unsigned int _refcount;
+};
+
+#endif
@@ -0,0 +1,385 @@
+/*
+ * qbatchremove.cpp
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "qbatchremove.h"
+#include "qmodel.h"
+#include "qforeignkey_p.h"
+#include "qtormdatabase.h"
+#include "qsqlwriter_p.h"
+
+#include <QVector>
+#include <QList>
+#include <QSet>
+#include <QMap>
+#include <QtSql>
+#include <QtDebug>
+
+struct QBatchRemove::Private
+{
+    Private()
+     : cascade(false),
+       chunk_size(500)
+    {
+    }
+
+    struct Entry
+    {
+        QModel *model;
+        QVariantList pks;
+        QSet<QString> known_pks;
+        QList<int> parents;
+    };
+
+    bool cascade;
+    int chunk_size;
+
+    QList<Entry> entries;
+    QMap<QForeignKeyPrivate::Factory, QString> target_tables;
+
+    int entry(QModel *model);
+    void addPrimaryKey(int entry, const QVariant &pk);
+    QString targetTable(QForeignKeyPrivate *key);
+    void findParents();
+};
+
+int QBatchRemove::Private::entry(QModel *model)
+{
+    // Models are identified by their table, so that several instances of a
+    // same model share their keys
+    for (int i=0; i<entries.size(); ++i)
+    {
+        if (entries.at(i).model->tableName() == model->tableName())
+            return i;
+    }
+
+    Entry e;
+
+    e.model = model;
+    entries.append(e);
+
+    return entries.size() - 1;
+}
+
+void QBatchRemove::Private::addPrimaryKey(int entry, const QVariant &pk)
+{
+    Entry &e = entries[entry];
+    QString key = pk.toString();
+
+    if (pk.isNull() || e.known_pks.contains(key))
+        return;
+
+    e.known_pks.insert(key);
+    e.pks.append(pk);
+}
+
+QString QBatchRemove::Private::targetTable(QForeignKeyPrivate *key)
+{
+    // The value of the key may not be set, an instance of the target model
+    // gives the table. One per model, only for the time of the batch remove.
+    QForeignKeyPrivate::Factory factory = key->schema()->target_factory;
+
+    if (!factory)
+        return (key->value() ? key->value()->tableName() : QString());
+
+    QMap<QForeignKeyPrivate::Factory, QString>::const_iterator it = target_tables.constFind(factory);
+
+    if (it != target_tables.constEnd())
+        return it.value();
+
+    QModel *target = key->createTarget();
+    QString rs = target->tableName();
+
+    delete target;
+    target_tables.insert(factory, rs);
+
+    return rs;
+}
+
+void QBatchRemove::Private::findParents()
+{
+    // Entries whose table is targeted by a foreign key of each entry
+    for (int e=0; e<entries.size(); ++e)
+    {
+        QVector<QForeignKeyPrivate *> keys;
+        QList<int> &rs = entries[e].parents;
+
+        rs.clear();
+        entries.at(e).model->getForeignKeys(keys);
+
+        for (int i=0; i<keys.count(); ++i)
+        {
+            QString table = targetTable(keys.at(i));
+
+            if (table.isEmpty())
+                continue;
+
+            for (int j=0; j<entries.size(); ++j)
+            {
+                if (j != e &&
+                    entries.at(j).model->tableName() == table &&
+                    !rs.contains(j))
+                {
+                    rs.append(j);
+                }
+            }
+        }
+    }
+}
+
+QBatchRemove::QBatchRemove()
+: d(new Private)
+{
+}
+
+QBatchRemove::~QBatchRemove()
+{
+    delete d;
+}
+
+void QBatchRemove::addPrimaryKeys(QModel *model, const QVariantList &pks)
+{
+    int e = d->entry(model);
+
+    for (int i=0; i<pks.count(); ++i)
+        d->addPrimaryKey(e, pks.at(i));
+}
+
+void QBatchRemove::addModel(QModel *model)
+{
+    d->entry(model);
+}
+
+void QBatchRemove::setCascade(bool cascade)
+{
+    d->cascade = cascade;
+}
+
+void QBatchRemove::setChunkSize(int rows)
+{
+    d->chunk_size = rows;
+}
+
+void QBatchRemove::clear()
+{
+    d->entries.clear();
+}
+
+int QBatchRemove::chunkSize() const
+{
+    int rs = QtOrmDatabase::maxBindValues(QtOrmDatabase::threadDatabase());
+
+    if (d->chunk_size > 0)
+        rs = qMin(rs, d->chunk_size);
+
+    return rs;
+}
+
+QList<int> QBatchRemove::removeOrder()
+{
+    // Topological sort of the entries, children (that have a foreign key to
+    // another entry) first
+    QList<int> rs;
+    QVector<int> children_left(d->entries.size(), 0);
+
+    d->findParents();
+
+    for (int i=0; i<d->entries.size(); ++i)
+    {
+        const QList<int> &parents = d->entries.at(i).parents;
+
+        for (int j=0; j<parents.size(); ++j)
+            children_left[parents.at(j)]++;
+    }
+
+    QList<int> ready;
+
+    for (int i=0; i<d->entries.size(); ++i)
+        if (children_left.at(i) == 0)
+            ready.append(i);
+
+    while (!ready.isEmpty())
+    {
+        int e = ready.takeFirst();
+
+        rs.append(e);
+
+        const QList<int> &parents = d->entries.at(e).parents;
+
+        for (int j=0; j<parents.size(); ++j)
+        {
+            int parent = parents.at(j);
+
+            if (--children_left[parent] == 0)
+                ready.append(parent);
+        }
+    }
+
+    if (rs.size() != d->entries.size())
+    {
+        // Foreign keys form a cycle, remove the remaining tables in the order
+        // in which they were added
+        qDebug() << "Cyclic foreign keys between the tables of a batch remove";
+
+        for (int i=0; i<d->entries.size(); ++i)
+            if (!rs.contains(i))
+                rs.append(i);
+    }
+
+    return rs;
+}
+
+bool QBatchRemove::fetchChildren(int child, int parent)
+{
+    QSqlDatabase db = QtOrmDatabase::threadDatabase();
+    QSqlDriver *driver = db.driver();
+    QSqlQuery query(db);
+
+    QModel *child_model = d->entries.at(child).model;
+    QModel *parent_model = d->entries.at(parent).model;
+    QVector<QForeignKeyPrivate *> keys;
+    int chunk = chunkSize();
+
+    child_model->getForeignKeys(keys);
+
+    for (int k=0; k<keys.count(); ++k)
+    {
+        if (d->targetTable(keys.at(k)) != parent_model->tableName())
+            continue;
+
+        // Select the rows of the child that reference the parent rows. The
+        // list of parent keys can grow when the child is the parent (self
+        // referencing foreign key), and then the new keys are also explored.
+        for (int start=0; start<d->entries.at(parent).pks.size(); start += chunk)
+        {
+            const QVariantList &pks = d->entries.at(parent).pks;
+            int count = qMin(chunk, pks.size() - start);
+            QSqlWriter writer(driver, 64 + count * 3);
+
+            writer << "SELECT ";
+            writer.appendName(child_model->pk());
+            writer << " FROM ";
+            writer.appendTableName(child_model);
+            writer << " WHERE ";
+            writer.appendName(QField(keys.at(k), true));
+            writer << " IN (";
+            writer.appendValues(pks.mid(start, count));
+            writer << ");";
+
+            query.prepare(writer.sql());
+
+            for (int i=0; i<count; ++i)
+                query.addBindValue(writer.values().at(i));
+
+            if (!QtOrmDatabase::exec(db, query, writer.sql(), writer.values(), QtOrmInstrumentation::Select, child_model->tableName()))
+            {
+                qDebug() << "Could not select the rows to remove :" << query.lastError();
+                return false;
+            }
+
+            while (query.next())
+                d->addPrimaryKey(child, query.value(0));
+        }
+    }
+
+    return true;
+}
+
+bool QBatchRemove::removeRows(int entry, int *affectedRows)
+{
+    QSqlDatabase db = QtOrmDatabase::threadDatabase();
+    QSqlDriver *driver = db.driver();
+    QSqlQuery query(db);
+
+    const Private::Entry &e = d->entries.at(entry);
+    int chunk = chunkSize();
+
+    for (int start=0; start<e.pks.size(); start += chunk)
+    {
+        int count = qMin(chunk, e.pks.size() - start);
+        QSqlWriter writer(driver, 64 + count * 3);
+
+        writer << "DELETE FROM ";
+        writer.appendTableName(e.model);
+        writer << " WHERE ";
+        writer.appendName(e.model->pk());
+        writer << " IN (";
+        writer.appendValues(e.pks.mid(start, count));
+        writer << ");";
+
+        query.prepare(writer.sql());
+
+        for (int i=0; i<count; ++i)
+            query.addBindValue(writer.values().at(i));
+
+        if (!QtOrmDatabase::exec(db, query, writer.sql(), writer.values(), QtOrmInstrumentation::Delete, e.model->tableName()))
+        {
+            qDebug() << "Could not remove objects :" << query.lastError();
+            return false;
+        }
+
+        if (affectedRows)
+            *affectedRows += query.numRowsAffected();
+    }
+
+    return true;
+}
+
+bool QBatchRemove::exec(int *affectedRows)
+{
+    QSqlDatabase db = QtOrmDatabase::threadDatabase();
+    QList<int> order = removeOrder();
+    bool transaction = db.transaction();
+    bool ok = true;
+
+    if (affectedRows)
+        *affectedRows = 0;
+
+    if (d->cascade)
+    {
+        // Parents first, so that the keys of a table are complete when its
+        // own children are explored. removeOrder() found the parents.
+        for (int i=order.size()-1; ok && i>=0; --i)
+        {
+            int parent = order.at(i);
+
+            for (int child=0; ok && child<d->entries.size(); ++child)
+            {
+                if (child == parent || d->entries.at(child).parents.contains(parent))
+                    ok = fetchChildren(child, parent);
+            }
+        }
+    }
+
+    // Remove the rows, children first
+    for (int i=0; ok && i<order.size(); ++i)
+        ok = removeRows(order.at(i), affectedRows);
+
+    if (transaction)
+    {
+        if (ok)
+            ok = db.commit();
+        else
+            db.rollback();
+    }
+
+    return ok;
+}
@@ -0,0 +1,57 @@
+/*
+ * qbatchremove.h
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef __QBATCHREMOVE_H__
+#define __QBATCHREMOVE_H__
+
+#include <QVariant>
+
+class QModel;
+
+class QBatchRemove
+{
+    private:
+        Q_DISABLE_COPY(QBatchRemove)
+
+    public:
+        QBatchRemove();
+        ~QBatchRemove();
+
+        void addPrimaryKeys(QModel *model, const QVariantList &pks);
+        void addModel(QModel *model);
+        void setCascade(bool cascade);
+        void setChunkSize(int rows);
+        void clear();
+
+        bool exec(int *affectedRows = 0);
+
+    private:
+        struct Private;
+        Private *d;
+
+        QList<int> removeOrder();
+        bool fetchChildren(int child, int parent);
+        bool removeRows(int entry, int *affectedRows);
+        int chunkSize() const;
+};
+
+#endif
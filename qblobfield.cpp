@@ -0,0 +1,635 @@
+/*
+ * qblobfield.cpp
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "qblobfield.h"
+#include "qfield_p.h"
+#include "qmodel.h"
+#include "qtormdatabase.h"
+#include "qsqlwriter_p.h"
+
+#include <QIODevice>
+#include <QtSql>
+#include <QtDebug>
+
+#include <limits.h>
+
+#ifdef QTORM_SQLITE_BLOB
+#include <sqlite3.h>
+#endif
+
+class QBlobFieldPrivate : public QFieldPrivate
+{
+    public:
+        QBlobFieldPrivate(QModel *model, const QString &name);
+        ~QBlobFieldPrivate();
+
+        void setValue(const QByteArray &value);
+        QByteArray value();
+
+        bool read(QIODevice *device, int chunkSize);
+        bool write(QIODevice *device, int chunkSize);
+
+        void fromData(const QVariant &data);
+        QVariant data() const;
+        QString sqlType() const;
+        QString sqlDescription() const;
+
+        bool isLazy() const;
+        void setLoaded(bool loaded);
+
+    private:
+        void appendChunk(QSqlWriter &writer, QtOrmDatabase::Dialect dialect);
+        void appendConcat(QSqlWriter &writer, QtOrmDatabase::Dialect dialect);
+        void appendUpdate(QSqlWriter &writer, const char *value);
+        bool execBound(QSqlDatabase &db, QSqlQuery &query, const QString &sql, const QVariantList &values,
+                       QtOrmInstrumentation::StatementKind kind);
+
+        bool writeAll(QSqlDatabase &db, QIODevice *device);
+        bool writeChunks(QSqlDatabase &db, QIODevice *device, int chunkSize);
+
+#ifdef QTORM_SQLITE_BLOB
+        bool rowId(QSqlDatabase &db, qint64 &rowid, bool &null);
+        bool readIncremental(sqlite3 *handle, QSqlDatabase &db, QIODevice *device, int chunkSize);
+        bool writeIncremental(sqlite3 *handle, QSqlDatabase &db, QIODevice *device, int chunkSize);
+#endif
+};
+
+#ifdef QTORM_SQLITE_BLOB
+// Connection of the SQLite driver, Qt must use the SQLite library QtORM is linked to
+static sqlite3 *sqliteHandle(const QSqlDatabase &db)
+{
+    QVariant handle = db.driver()->handle();
+
+    if (!handle.isValid() || qstrcmp(handle.typeName(), "sqlite3*") != 0)
+        return NULL;
+
+    return *static_cast<sqlite3 *const *>(handle.constData());
+}
+#endif
+
+QBlobFieldPrivate::QBlobFieldPrivate(QModel *model, const QString &name)
+ : QFieldPrivate(model, name)
+{
+    allocateValue<QByteArray>(QByteArray());
+}
+
+QBlobFieldPrivate::~QBlobFieldPrivate()
+{
+
+}
+
+void QBlobFieldPrivate::setValue(const QByteArray &value)
+{
+    setNull(false); // The field is not null anymore
+    setModified(true);
+    rowValue<QByteArray>() = value;
+}
+
+QByteArray QBlobFieldPrivate::value()
+{
+    ensureLoaded();
+
+    if (isNull())
+        return QByteArray();
+
+    return rowValue<QByteArray>();
+}
+
+void QBlobFieldPrivate::fromData(const QVariant &data)
+{
+    setNull(data.isNull());
+    setModified(false);
+    rowValue<QByteArray>() = data.toByteArray();
+}
+
+QVariant QBlobFieldPrivate::data() const
+{
+    if (isNull())
+        return QVariant(QVariant::ByteArray);
+    else
+        return QVariant(rowValue<QByteArray>());
+}
+
+QString QBlobFieldPrivate::sqlType() const
+{
+    switch (QtOrmDatabase::dialect(QtOrmDatabase::threadDatabase()))
+    {
+        case QtOrmDatabase::PostgreSQL:
+            return QLatin1String("BYTEA");
+        case QtOrmDatabase::MySQL:
+            return QLatin1String("LONGBLOB");   // BLOB is limited to 64 KiB
+        default:
+            return QLatin1String("BLOB");
+    }
+}
+
+QString QBlobFieldPrivate::sqlDescription() const
+{
+    QString rs = sqlType();
+
+    rs += commonSqlDescription();
+
+    return rs;
+}
+
+bool QBlobFieldPrivate::isLazy() const
+{
+    return true;
+}
+
+void QBlobFieldPrivate::setLoaded(bool loaded)
+{
+    QFieldPrivate::setLoaded(loaded);
+
+    // Don't keep a stale value in memory
+    if (!loaded)
+        rowValue<QByteArray>() = QByteArray();
+}
+
+void QBlobFieldPrivate::appendChunk(QSqlWriter &writer, QtOrmDatabase::Dialect dialect)
+{
+    // Part of the value starting at a 1-based offset, of a given length
+    switch (dialect)
+    {
+        case QtOrmDatabase::SQLite:
+            writer << "substr(" << escapedName(writer.driver()) << ", ?, ?)";
+            break;
+        case QtOrmDatabase::PostgreSQL:
+            writer << "substring(" << escapedName(writer.driver()) << " from ? for ?)";
+            break;
+        case QtOrmDatabase::MySQL:
+            writer << "SUBSTRING(" << escapedName(writer.driver()) << ", ?, ?)";
+            break;
+        default:
+            writer << "SUBSTRING(" << escapedName(writer.driver()) << " FROM ? FOR ?)";
+            break;
+    }
+}
+
+void QBlobFieldPrivate::appendConcat(QSqlWriter &writer, QtOrmDatabase::Dialect dialect)
+{
+    // Current value followed by a bound chunk, without going through text
+    switch (dialect)
+    {
+        case QtOrmDatabase::MySQL:
+            writer << "CONCAT(" << escapedName(writer.driver()) << ", ?)";
+            break;
+        default:
+            writer << escapedName(writer.driver()) << " || ?";
+            break;
+    }
+}
+
+void QBlobFieldPrivate::appendUpdate(QSqlWriter &writer, const char *value)
+{
+    writer << "UPDATE ";
+    writer.appendTableName(_model);
+    writer << " SET " << escapedName(writer.driver()) << " = " << value << " WHERE ";
+    writer.appendName(_model->pk());
+    writer << " = ?;";
+}
+
+// Bind the values of a prepared statement and run it, logged if slow
+bool QBlobFieldPrivate::execBound(QSqlDatabase &db, QSqlQuery &query, const QString &sql, const QVariantList &values,
+                                  QtOrmInstrumentation::StatementKind kind)
+{
+    for (int i=0; i<values.count(); ++i)
+        query.addBindValue(values.at(i));
+
+    return QtOrmDatabase::exec(db, query, sql, values, kind, _model->tableName());
+}
+
+#ifdef QTORM_SQLITE_BLOB
+bool QBlobFieldPrivate::rowId(QSqlDatabase &db, qint64 &rowid, bool &null)
+{
+    QSqlQuery query(db);
+    QSqlWriter writer(db.driver());
+
+    writer.setPlaceholderStyle(QSqlWriter::PositionalPlaceholders);
+    writer << "SELECT rowid, " << escapedName(db.driver()) << " IS NULL FROM ";
+    writer.appendTableName(_model);
+    writer << " WHERE ";
+    writer.appendName(_model->pk());
+    writer << " = ?;";
+
+    query.prepare(writer.sql());
+
+    if (!execBound(db, query, writer.sql(), QVariantList() << _model->pk().data(), QtOrmInstrumentation::Select) ||
+        !query.next())
+    {
+        qDebug() << "Could not find the row of field" << name() << ":" << query.lastError();
+        return false;
+    }
+
+    rowid = query.value(0).toLongLong();
+    null = query.value(1).toBool();
+
+    return true;
+}
+
+bool QBlobFieldPrivate::readIncremental(sqlite3 *handle, QSqlDatabase &db, QIODevice *device, int chunkSize)
+{
+    qint64 rowid;
+    bool null;
+    sqlite3_blob *blob;
+
+    if (!rowId(db, rowid, null))
+        return false;
+
+    if (null)
+        return true;
+
+    if (sqlite3_blob_open(handle, "main", _model->tableName().toUtf8().constData(),
+                          name().toUtf8().constData(), rowid, 0, &blob) != SQLITE_OK)
+    {
+        qDebug() << "Could not open field" << name() << ":" << sqlite3_errmsg(handle);
+        return false;
+    }
+
+    int size = sqlite3_blob_bytes(blob);
+    QByteArray chunk(qMin(chunkSize, size), '\0');
+    bool ok = true;
+
+    for (int offset=0; ok && offset<size; offset+=chunkSize)
+    {
+        int length = qMin(chunkSize, size - offset);
+
+        if (sqlite3_blob_read(blob, chunk.data(), length, offset) != SQLITE_OK)
+        {
+            qDebug() << "Could not read field" << name() << ":" << sqlite3_errmsg(handle);
+            ok = false;
+        }
+        else if (device->write(chunk.constData(), length) != length)
+        {
+            ok = false;
+        }
+    }
+
+    sqlite3_blob_close(blob);
+
+    return ok;
+}
+
+bool QBlobFieldPrivate::writeIncremental(sqlite3 *handle, QSqlDatabase &db, QIODevice *device, int chunkSize)
+{
+    QByteArray buffered;
+    qint64 size;
+
+    // zeroblob() needs the size of the value, a sequential device is read at once
+    if (device->isSequential())
+    {
+        buffered = device->readAll();
+        size = buffered.size();
+    }
+    else
+    {
+        size = device->size() - device->pos();
+    }
+
+    if (size > INT_MAX)
+    {
+        qDebug() << "Cannot store" << size << "bytes in field" << name();
+        return false;
+    }
+
+    QSqlQuery query(db);
+    QSqlWriter writer(db.driver());
+
+    writer.setPlaceholderStyle(QSqlWriter::PositionalPlaceholders);
+    appendUpdate(writer, "zeroblob(?)");
+
+    query.prepare(writer.sql());
+
+    if (!execBound(db, query, writer.sql(), QVariantList() << int(size) << _model->pk().data(), QtOrmInstrumentation::Update))
+    {
+        qDebug() << "Could not write field" << name() << ":" << query.lastError();
+        return false;
+    }
+
+    qint64 rowid;
+    bool null;
+    sqlite3_blob *blob;
+
+    query.finish();
+
+    if (size == 0)
+        return true;
+
+    if (!rowId(db, rowid, null))
+        return false;
+
+    if (sqlite3_blob_open(handle, "main", _model->tableName().toUtf8().constData(),
+                          name().toUtf8().constData(), rowid, 1, &blob) != SQLITE_OK)
+    {
+        qDebug() << "Could not open field" << name() << ":" << sqlite3_errmsg(handle);
+        return false;
+    }
+
+    // The chunks are written in place, the value is never rewritten
+    bool ok = true;
+
+    for (int offset=0; ok && offset<size; )
+    {
+        int length = qMin(qint64(chunkSize), size - offset);
+        QByteArray chunk = (buffered.isNull() ? device->read(length) : buffered.mid(offset, length));
+
+        if (chunk.size() != length)
+        {
+            qDebug() << "Could not write field" << name() << ": the device ended after" << offset + chunk.size() << "bytes";
+            ok = false;
+        }
+        else if (sqlite3_blob_write(blob, chunk.constData(), length, offset) != SQLITE_OK)
+        {
+            qDebug() << "Could not write field" << name() << ":" << sqlite3_errmsg(handle);
+            ok = false;
+        }
+
+        offset += length;
+    }
+
+    if (sqlite3_blob_close(blob) != SQLITE_OK)
+        ok = false;
+
+    return ok;
+}
+#endif
+
+bool QBlobFieldPrivate::writeAll(QSqlDatabase &db, QIODevice *device)
+{
+    QSqlQuery query(db);
+    QSqlWriter writer(db.driver());
+    QByteArray value = device->readAll();
+
+    if (value.isNull())
+        value = QByteArray("", 0);     // Empty but not NULL
+
+    writer.setPlaceholderStyle(QSqlWriter::PositionalPlaceholders);
+    appendUpdate(writer, "?");
+
+    query.prepare(writer.sql());
+
+    if (!execBound(db, query, writer.sql(), QVariantList() << value << _model->pk().data(), QtOrmInstrumentation::Update))
+    {
+        qDebug() << "Could not write field" << name() << ":" << query.lastError();
+        return false;
+    }
+
+    return true;
+}
+
+bool QBlobFieldPrivate::writeChunks(QSqlDatabase &db, QIODevice *device, int chunkSize)
+{
+    const QField &pk = _model->pk();
+    QSqlQuery query(db);
+    QSqlWriter set(db.driver()), append(db.driver());
+
+    set.setPlaceholderStyle(QSqlWriter::PositionalPlaceholders);
+    append.setPlaceholderStyle(QSqlWriter::PositionalPlaceholders);
+
+    // The first chunk replaces the value, the next ones are appended to it
+    appendUpdate(set, "?");
+
+    append << "UPDATE ";
+    append.appendTableName(_model);
+    append << " SET " << escapedName(db.driver()) << " = ";
+    appendConcat(append, QtOrmDatabase::dialect(db));
+    append << " WHERE ";
+    append.appendName(pk);
+    append << " = ?;";
+
+    bool ok = true;
+    bool first = true;
+
+    query.prepare(set.sql());
+
+    while (ok && (first || !device->atEnd()))
+    {
+        QByteArray chunk = device->read(chunkSize);
+
+        if (chunk.isNull())
+            chunk = QByteArray("", 0);     // Empty but not NULL
+
+        if (!first && chunk.isEmpty())
+            break;
+
+        ok = execBound(db, query, first ? set.sql() : append.sql(), QVariantList() << chunk << pk.data(),
+                       QtOrmInstrumentation::Update);
+
+        if (first)
+        {
+            query.prepare(append.sql());
+            first = false;
+        }
+    }
+
+    if (!ok)
+        qDebug() << "Could not write field" << name() << ":" << query.lastError();
+
+    return ok;
+}
+
+bool QBlobFieldPrivate::read(QIODevice *device, int chunkSize)
+{
+    const QField &pk = _model->pk();
+
+    if (chunkSize <= 0)
+    {
+        qDebug() << "Cannot read field" << name() << "by chunks of" << chunkSize << "bytes";
+        return false;
+    }
+
+    // The value is already in memory, or there is nothing in the database
+    if (isLoaded() || pk.isNull())
+    {
+        if (!isNull())
+        {
+            const QByteArray &value = rowValue<QByteArray>();
+
+            for (int offset=0; offset<value.size(); offset+=chunkSize)
+            {
+                if (device->write(value.constData() + offset, qMin(chunkSize, value.size() - offset)) < 0)
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    QSqlDatabase db = QtOrmDatabase::threadDatabase();
+
+#ifdef QTORM_SQLITE_BLOB
+    sqlite3 *handle = (QtOrmDatabase::dialect(db) == QtOrmDatabase::SQLite ? sqliteHandle(db) : NULL);
+
+    if (handle)
+        return readIncremental(handle, db, device, chunkSize);
+#endif
+
+    QSqlQuery query(db);
+    QSqlWriter writer(db.driver());
+
+    // Positional placeholders, the query is executed once per chunk
+    writer.setPlaceholderStyle(QSqlWriter::PositionalPlaceholders);
+
+    writer << "SELECT ";
+    appendChunk(writer, QtOrmDatabase::dialect(db));
+    writer << " FROM ";
+    writer.appendTableName(_model);
+    writer << " WHERE ";
+    writer.appendName(pk);
+    writer << " = ?;";
+
+    query.prepare(writer.sql());
+
+    for (int offset=1; ; offset+=chunkSize)
+    {
+        if (!execBound(db, query, writer.sql(), QVariantList() << offset << chunkSize << pk.data(), QtOrmInstrumentation::Select) ||
+            !query.next())
+        {
+            qDebug() << "Could not read field" << name() << ":" << query.lastError();
+            return false;
+        }
+
+        QVariant chunk = query.value(0);
+
+        if (chunk.isNull())
+            break;
+
+        QByteArray bytes = chunk.toByteArray();
+
+        if (device->write(bytes) != bytes.size())
+            return false;
+
+        // A short chunk is the last one
+        if (bytes.size() < chunkSize)
+            break;
+    }
+
+    return true;
+}
+
+bool QBlobFieldPrivate::write(QIODevice *device, int chunkSize)
+{
+    const QField &pk = _model->pk();
+
+    if (chunkSize <= 0)
+    {
+        qDebug() << "Cannot write field" << name() << "by chunks of" << chunkSize << "bytes";
+        return false;
+    }
+
+    if (pk.isNull())
+    {
+        qDebug() << "Cannot stream field" << name() << "of an object not saved yet";
+        return false;
+    }
+
+    QSqlDatabase db = QtOrmDatabase::threadDatabase();
+    QtOrmDatabase::Dialect dialect = QtOrmDatabase::dialect(db);
+
+    // Run everything in one transaction if we are not already in one
+    bool transaction = db.transaction();
+    bool ok;
+
+#ifdef QTORM_SQLITE_BLOB
+    sqlite3 *handle = (dialect == QtOrmDatabase::SQLite ? sqliteHandle(db) : NULL);
+
+    if (handle)
+        ok = writeIncremental(handle, db, device, chunkSize);
+    else
+#endif
+    if (dialect == QtOrmDatabase::SQLite)
+        ok = writeAll(db, device);      // || would go through text, in the encoding of the database
+    else
+        ok = writeChunks(db, device, chunkSize);
+
+    // The transaction of the caller is left to the caller
+    if (transaction)
+    {
+        if (ok)
+            ok = db.commit();
+        else
+            db.rollback();
+    }
+
+    if (!ok)
+        return false;
+
+    // The value is now in the database only
+    setNull(false);
+    setLoaded(false);
+
+    return true;
+}
+
+/*
+ * QBlobField
+ */
+
+QBlobField::QBlobField()
+ : QField(NULL)
+{
+}
+
+QBlobField::QBlobField(QModel *model, const QString &name)
+ : QField(new (model) QBlobFieldPrivate(model, name))
+{
+}
+
+QBlobField::~QBlobField()
+{
+}
+
+QBlobField::operator QByteArray() const
+{
+    return dptr()->value();
+}
+
+QByteArray QBlobField::value() const
+{
+    return dptr()->value();
+}
+
+void QBlobField::setValue(const QByteArray &value)
+{
+    dptr()->setValue(value);
+}
+
+QBlobField &QBlobField::operator=(const QByteArray &value)
+{
+    dptr()->setValue(value);
+    return *this;
+}
+
+bool QBlobField::read(QIODevice *device, int chunkSize) const
+{
+    return dptr()->read(device, chunkSize);
+}
+
+bool QBlobField::write(QIODevice *device, int chunkSize)
+{
+    return dptr()->write(device, chunkSize);
+}
+
+QBlobFieldPrivate *QBlobField::dptr() const
+{
+    return (QBlobFieldPrivate *)d;
+}
@@ -0,0 +1,73 @@
+/*
+ * qblobfield.h
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef __QBLOBFIELD_H__
+#define __QBLOBFIELD_H__
+
+#include "qfield.h"
+#include <QByteArray>
+
+class QBlobFieldPrivate;
+class QIODevice;
+
+/*
+ * Binary field, not fetched with the rows of a QQuerySet unless explicitly
+ * selected. Its value is loaded on first access, or streamed by chunks with
+ * read() and write().
+ *
+ * On SQLite, when QtORM is built with QTORM_SQLITE_BLOB, the chunks are read
+ * and written in place with the incremental blob API. Without it, write()
+ * stores the content of the device in one statement. On PostgreSQL, MySQL and
+ * the other databases, every chunk written is appended to the value with an
+ * UPDATE that rewrites the whole value: writing n bytes costs O(n^2) of I/O,
+ * use chunks as large as memory allows.
+ */
+class QBlobField : public QField
+{
+    public:
+        QBlobField();
+        QBlobField(QModel *model, const QString &name);
+        ~QBlobField();
+
+        operator QByteArray() const;
+        QByteArray value() const;   /*!< @brief Value of the field, loaded from the database if needed */
+        void setValue(const QByteArray &value);
+        QBlobField &operator=(const QByteArray &value);
+
+        bool read(QIODevice *device, int chunkSize = 65536) const;   /*!< @brief Copy the value to device, one chunk at a time */
+        bool write(QIODevice *device, int chunkSize = 65536);        /*!< @brief Store the content of device in the database, one chunk at a time */
+
+        _Q_F_ASSIGN(QBlobField)
+
+    private:
+        QBlobFieldPrivate *dptr() const;
+};
+
+Q_DECLARE_TYPEINFO(QBlobField, Q_MOVABLE_TYPE);
+
+template<>
+struct QFieldTraits<QBlobField>
+{
+    typedef QByteArray ValueType;
+};
+
+#endif
@@ -30,19 +30,18 @@ class QDateTimeFieldPrivate : public QFieldPrivate
         ~QDateTimeFieldPrivate();
 
         void setValue(const QDateTime &value);
+        QDateTime value() const;
 
         void fromData(const QVariant &data);
         QVariant data() const;
+        QString sqlType() const;
         QString sqlDescription() const;
-
-    private:
-        QDateTime _datetime;
 };
 
 QDateTimeFieldPrivate::QDateTimeFieldPrivate(QModel *model, const QString &name)
  : QFieldPrivate(model, name)
 {
-
+    allocateValue<QDateTime>(QDateTime());
 }
 
 QDateTimeFieldPrivate::~QDateTimeFieldPrivate()
@@ -54,14 +53,24 @@ void QDateTimeFieldPrivate::setValue(const QDateTime &value)
 {
     setNull(false); // The field is not null anymore
     setModified(true);
-    _datetime = value;
+    rowValue<QDateTime>() = value;
+}
+
+QDateTime QDateTimeFieldPrivate::value() const
+{
+    ensureLoaded();
+
+    if (isNull())
+        return QDateTime();
+
+    return rowValue<QDateTime>();
 }
 
 void QDateTimeFieldPrivate::fromData(const QVariant &data)
 {
     setNull(data.isNull());
     setModified(false);
-    _datetime = data.toDateTime();
+    rowValue<QDateTime>() = data.toDateTime();
 }
 
 QVariant QDateTimeFieldPrivate::data() const
@@ -69,12 +78,17 @@ QVariant QDateTimeFieldPrivate::data() const
     if (isNull())
         return QVariant();
     else
-        return QVariant(_datetime);
+        return QVariant(rowValue<QDateTime>());
+}
+
+QString QDateTimeFieldPrivate::sqlType() const
+{
+    return QLatin1String("DATETIME");
 }
 
 QString QDateTimeFieldPrivate::sqlDescription() const
 {
-    QString rs = QLatin1String("DATETIME");
+    QString rs = sqlType();
 
     rs += commonSqlDescription();
 
@@ -91,7 +105,7 @@ QDateTimeField::QDateTimeField()
 }
 
 QDateTimeField::QDateTimeField(QModel *model, const QString &name)
- : QField(new QDateTimeFieldPrivate(model, name))
+ : QField(new (model) QDateTimeFieldPrivate(model, name))
 {
 }
 
@@ -101,7 +115,17 @@ QDateTimeField::~QDateTimeField()
 
 QDateTimeField::operator QDateTime() const
 {
-    return dptr()->data().toDateTime();
+    return dptr()->value();
+}
+
+QDateTime QDateTimeField::value() const
+{
+    return dptr()->value();
+}
+
+void QDateTimeField::setValue(const QDateTime &value)
+{
+    dptr()->setValue(value);
 }
 
 QDateTimeField &QDateTimeField::operator=(const QDateTime &value)
@@ -36,6 +36,8 @@ class QDateTimeField : public QField
         ~QDateTimeField();
 
         operator QDateTime() const;
+        QDateTime value() const;    /*!< @brief Value of the field, read without QVariant */
+        void setValue(const QDateTime &value);
         QDateTimeField &operator=(const QDateTime &value);
 
         _Q_F_ASSIGN(QDateTimeField)
@@ -46,4 +48,10 @@ class QDateTimeField : public QField
 
 Q_DECLARE_TYPEINFO(QDateTimeField, Q_MOVABLE_TYPE);
 
+template<>
+struct QFieldTraits<QDateTimeField>
+{
+    typedef QDateTime ValueType;
+};
+
 #endif
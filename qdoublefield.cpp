@@ -30,19 +30,18 @@ class QDoubleFieldPrivate : public QFieldPrivate
         ~QDoubleFieldPrivate();
 
         void setValue(double value);
+        double value() const;
 
         void fromData(const QVariant &data);
         QVariant data() const;
+        QString sqlType() const;
         QString sqlDescription() const;
-
-    private:
-        double _value;
 };
 
 QDoubleFieldPrivate::QDoubleFieldPrivate(QModel *model, const QString &name)
- : QFieldPrivate(model, name), _value(0)
+ : QFieldPrivate(model, name)
 {
-
+    allocateValue<double>(0);
 }
 
 QDoubleFieldPrivate::~QDoubleFieldPrivate()
@@ -54,14 +53,24 @@ void QDoubleFieldPrivate::setValue(double value)
 {
     setNull(false); // The field is not null anymore
     setModified(true);
-    _value = value;
+    rowValue<double>() = value;
+}
+
+double QDoubleFieldPrivate::value() const
+{
+    ensureLoaded();
+
+    if (isNull())
+        return 0;
+
+    return rowValue<double>();
 }
 
 void QDoubleFieldPrivate::fromData(const QVariant &data)
 {
     setNull(data.isNull());
     setModified(false);
-    _value = data.toDouble();
+    rowValue<double>() = data.toDouble();
 }
 
 QVariant QDoubleFieldPrivate::data() const
@@ -69,12 +78,17 @@ QVariant QDoubleFieldPrivate::data() const
     if (isNull())
         return QVariant();
     else
-        return QVariant(_value);
+        return QVariant(rowValue<double>());
+}
+
+QString QDoubleFieldPrivate::sqlType() const
+{
+    return QLatin1String("DOUBLE");
 }
 
 QString QDoubleFieldPrivate::sqlDescription() const
 {
-    QString rs = QLatin1String("DOUBLE");
+    QString rs = sqlType();
 
     rs += commonSqlDescription();
 
@@ -91,7 +105,7 @@ QDoubleField::QDoubleField()
 }
 
 QDoubleField::QDoubleField(QModel *model, const QString &name)
- : QField(new QDoubleFieldPrivate(model, name))
+ : QField(new (model) QDoubleFieldPrivate(model, name))
 {
 }
 
@@ -101,7 +115,17 @@ QDoubleField::~QDoubleField()
 
 QDoubleField::operator double() const
 {
-    return dptr()->data().toDouble();
+    return dptr()->value();
+}
+
+double QDoubleField::value() const
+{
+    return dptr()->value();
+}
+
+void QDoubleField::setValue(double value)
+{
+    dptr()->setValue(value);
 }
 
 QDoubleField &QDoubleField::operator=(double value)
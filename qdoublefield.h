@@ -35,6 +35,8 @@ class QDoubleField : public QField
         ~QDoubleField();
 
         operator double() const;
+        double value() const;    /*!< @brief Value of the field, read without QVariant */
+        void setValue(double value);
         QDoubleField &operator=(double value);
 
         _Q_F_ASSIGN(QDoubleField)
@@ -45,4 +47,10 @@ class QDoubleField : public QField
 
 Q_DECLARE_TYPEINFO(QDoubleField, Q_MOVABLE_TYPE);
 
+template<>
+struct QFieldTraits<QDoubleField>
+{
+    typedef double ValueType;
+};
+
 #endif
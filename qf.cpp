@@ -22,90 +22,107 @@
 
 #include "qf.h"
 #include "qfield.h"
+#include "qfield_p.h"
 
-struct QF::Private
+QF::QF(const QField& f) : d(f.d)
 {
-    QField f;
-};
+    if (d)
+        d->ref();
+}
+
+QF::QF(const QF &other) : d(other.d)
+{
+    if (d)
+        d->ref();
+}
 
-QF::QF(const QField& f) : d(new Private)
+QF &QF::operator=(const QF &other)
 {
-    d->f = f;
+    if (other.d)
+        other.d->ref();
+
+    if (d && !d->deref())
+        QFieldPrivate::release(d);
+
+    d = other.d;
+
+    return *this;
 }
 
 QF::~QF()
 {
-    delete d;
+    if (d && !d->deref())
+        QFieldPrivate::release(d);
 }
 
 QField QF::field() const
 {
-    return d->f;
+    return QField(d, true);
 }
 
 QWhere QF::operator==(const QVariant &other) const
 {
-    return QFIWhere(d->f, other, QWhere::Equal);
+    return QFIWhere(field(), other, QWhere::Equal);
 }
 
 QWhere QF::operator!=(const QVariant &other) const
 {
-    return QFIWhere(d->f, other, QWhere::NotEqual);
+    return QFIWhere(field(), other, QWhere::NotEqual);
 }
 
 QWhere QF::operator<(const QVariant &other) const
 {
-    return QFIWhere(d->f, other, QWhere::Less);
+    return QFIWhere(field(), other, QWhere::Less);
 }
 
 QWhere QF::operator>(const QVariant &other) const
 {
-    return QFIWhere(d->f, other, QWhere::Greater);
+    return QFIWhere(field(), other, QWhere::Greater);
 }
 
 QWhere QF::operator<=(const QVariant &other) const
 {
-    return QFIWhere(d->f, other, QWhere::LessEqual);
+    return QFIWhere(field(), other, QWhere::LessEqual);
 }
 
 QWhere QF::operator>=(const QVariant &other) const
 {
-    return QFIWhere(d->f, other, QWhere::GreaterEqual);
+    return QFIWhere(field(), other, QWhere::GreaterEqual);
 }
 
 QWhere QF::operator==(const QField &other) const
 {
-    return QFFWhere(d->f, other, QWhere::Equal);
+    return QFFWhere(field(), other, QWhere::Equal);
 }
 
 QWhere QF::operator!=(const QField &other) const
 {
-    return QFFWhere(d->f, other, QWhere::NotEqual);
+    return QFFWhere(field(), other, QWhere::NotEqual);
 }
 
 QWhere QF::operator<(const QField &other) const
 {
-    return QFFWhere(d->f, other, QWhere::Less);
+    return QFFWhere(field(), other, QWhere::Less);
 }
 
 QWhere QF::operator>(const QField &other) const
 {
-    return QFFWhere(d->f, other, QWhere::Greater);
+    return QFFWhere(field(), other, QWhere::Greater);
 }
 
 QWhere QF::operator<=(const QField &other) const
 {
-    return QFFWhere(d->f, other, QWhere::LessEqual);
+    return QFFWhere(field(), other, QWhere::LessEqual);
 }
 
 QWhere QF::operator>=(const QField &other) const
 {
-    return QFFWhere(d->f, other, QWhere::GreaterEqual);
+    return QFFWhere(field(), other, QWhere::GreaterEqual);
 }
 
 QWhere QF::operator!() const
 {
-    return QFWhere(d->f, QWhere::Null);
+    return QFWhere(field(), QWhere::Null);
 }
 
 QAssign QF::operator+(const QAssign &other)
@@ -130,25 +147,25 @@ QAssign QF::operator/(const QAssign &other)
 
 QWhere QF::in(const QVariantList& other) const
 {
-    return QFInWhere(d->f, other);
+    return QFInWhere(field(), other);
 }
 
 QWhere QF::like(const QString& pattern) const
 {
-    return QFLikeWhere(d->f, pattern);
+    return QFLikeWhere(field(), pattern);
 }
 
 QWhere QF::divisibleBy(int divisor, int offset) const
 {
-    return QFDivWhere(d->f, divisor, offset);
+    return QFDivWhere(field(), divisor, offset);
 }
 
 QWhere QF::flagSet(int flag) const
 {
-    return QFFlagSetWhere(d->f, flag);
+    return QFFlagSetWhere(field(), flag);
 }
 
 QWhere QF::isNull() const
 {
-    return QFNullWhere(d->f);
+    return QFNullWhere(field());
 }
@@ -26,10 +26,15 @@
 #include "qwhere.h"
 #include "qassign.h"
 
+class QField;
+class QFieldPrivate;
+
 class QF
 {
     public:
         QF(const QField &f);
+        QF(const QF &other);
+        QF &operator=(const QF &other);
         ~QF();
 
         QField field() const;
@@ -64,8 +69,7 @@ class QF
         QAssign operator/(const QAssign &other);
 
     private:
-        struct Private;
-        Private *d;
+        QFieldPrivate *d;   /*!< @brief Field referenced directly, a QF is built for every predicate */
 };
 
 #endif
\ No newline at end of file
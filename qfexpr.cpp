@@ -0,0 +1,229 @@
+/*
+ * qfexpr.cpp
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "qfexpr.h"
+#include "qwhere_p.h"
+#include "qassign_p.h"
+#include "qsqlwriter_p.h"
+#include "qnodepool_p.h"
+
+#include <QStringList>
+#include <QByteArray>
+#include <QVarLengthArray>
+
+/*
+ * Skeletons
+ */
+
+class QFESkeleton
+{
+    public:
+        QFESkeleton() : texts(QStringList() << QString()) {}
+
+        QStringList texts;      // Text before each hole, and after the last one
+        QByteArray holes;       // 'f' for the name of a field, 'v' for a bound value
+};
+
+QFESkeletonWriter &QFESkeletonWriter::operator<<(const char *str)
+{
+    _skeleton->texts.last() += QLatin1String(str);
+
+    return *this;
+}
+
+QFESkeletonWriter &QFESkeletonWriter::operator<<(char c)
+{
+    _skeleton->texts.last() += QLatin1Char(c);
+
+    return *this;
+}
+
+void QFESkeletonWriter::field()
+{
+    _skeleton->holes.append('f');
+    _skeleton->texts.append(QString());
+}
+
+void QFESkeletonWriter::value()
+{
+    _skeleton->holes.append('v');
+    _skeleton->texts.append(QString());
+}
+
+static const QFESkeleton *skeleton(QFEType &type)
+{
+    QFESkeleton *rs = type.skeleton;
+
+    if (rs)
+        return rs;
+
+    rs = new QFESkeleton;
+
+    QFESkeletonWriter writer(rs);
+
+    type.write_skeleton(writer);
+
+    // Another thread may have written it meanwhile, a skeleton is never freed
+    if (!type.skeleton.testAndSetOrdered(NULL, rs))
+    {
+        delete rs;
+        rs = type.skeleton;
+    }
+
+    return rs;
+}
+
+static void render(QSqlWriter &writer, QFEType &type, const void *e)
+{
+    const QFESkeleton *s = skeleton(type);
+    QVarLengthArray<const QField *, 16> fields(type.fields);
+    QVarLengthArray<QVariant, 16> values(type.binds);
+    QFEOperands operands = { fields.data(), values.data(), 0, 0 };
+    int field = 0, value = 0;
+
+    type.operands(e, operands);
+
+    for (int i=0; i<s->holes.size(); ++i)
+    {
+        if (!s->texts.at(i).isEmpty())
+            writer << s->texts.at(i);
+
+        if (s->holes.at(i) == 'f')
+            writer.appendFieldName(*fields[field++]);
+        else
+            writer.appendValue(values[value++]);
+    }
+
+    if (!s->texts.last().isEmpty())
+        writer << s->texts.last();
+}
+
+/*
+ * Nodes, a node and the copy of its expression are one allocation from the
+ * node pool. The size of the allocation is stored before the node, the
+ * size given to operator delete does not count the expression.
+ */
+
+#define NODE_HEADER 16
+
+static inline size_t expressionOffset(size_t node_size)
+{
+    return (node_size + NODE_HEADER - 1) & ~size_t(NODE_HEADER - 1);
+}
+
+static void *allocateNode(size_t node_size, const QFEType &type)
+{
+    size_t size = NODE_HEADER + expressionOffset(node_size) + type.size;
+    char *ptr = static_cast<char *>(QNodePool::allocate(size));
+
+    *reinterpret_cast<size_t *>(ptr) = size;
+
+    return ptr + NODE_HEADER;
+}
+
+static void releaseNode(void *node)
+{
+    if (!node)
+        return;
+
+    char *ptr = static_cast<char *>(node) - NODE_HEADER;
+
+    QNodePool::release(ptr, *reinterpret_cast<size_t *>(ptr));
+}
+
+class QFEWherePrivate : public QWherePrivate
+{
+    public:
+        QFEWherePrivate(QFEType &type, const void *e, QWhere::Condition cond);
+        ~QFEWherePrivate();
+
+        static void *operator new(size_t size, const QFEType &type) { return allocateNode(size, type); }
+        static void operator delete(void *ptr, const QFEType &) { releaseNode(ptr); }
+        static void operator delete(void *ptr) { releaseNode(ptr); }
+
+        void writeSql(QSqlWriter &writer) const;
+
+    private:
+        void *expression() const { return (char *)this + expressionOffset(sizeof(QFEWherePrivate)); }
+
+        QFEType &_type;
+};
+
+QFEWherePrivate::QFEWherePrivate(QFEType &type, const void *e, QWhere::Condition cond)
+: QWherePrivate(cond), _type(type)
+{
+    type.copy(expression(), e);
+}
+
+QFEWherePrivate::~QFEWherePrivate()
+{
+    _type.destroy(expression());
+}
+
+void QFEWherePrivate::writeSql(QSqlWriter &writer) const
+{
+    render(writer, _type, expression());
+}
+
+class QFEAssignPrivate : public QAssignPrivate
+{
+    public:
+        QFEAssignPrivate(QFEType &type, const void *e);
+        ~QFEAssignPrivate();
+
+        static void *operator new(size_t size, const QFEType &type) { return allocateNode(size, type); }
+        static void operator delete(void *ptr, const QFEType &) { releaseNode(ptr); }
+        static void operator delete(void *ptr) { releaseNode(ptr); }
+
+        void writeSql(QSqlWriter &writer) const;
+
+    private:
+        void *expression() const { return (char *)this + expressionOffset(sizeof(QFEAssignPrivate)); }
+
+        QFEType &_type;
+};
+
+QFEAssignPrivate::QFEAssignPrivate(QFEType &type, const void *e)
+: _type(type)
+{
+    type.copy(expression(), e);
+}
+
+QFEAssignPrivate::~QFEAssignPrivate()
+{
+    _type.destroy(expression());
+}
+
+void QFEAssignPrivate::writeSql(QSqlWriter &writer) const
+{
+    render(writer, _type, expression());
+}
+
+QWhere qfeWhere(QFEType &type, const void *e, QWhere::Condition cond)
+{
+    return QWhere(new (type) QFEWherePrivate(type, e, cond));
+}
+
+QAssign qfeAssign(QFEType &type, const void *e)
+{
+    return QAssign(new (type) QFEAssignPrivate(type, e));
+}
@@ -0,0 +1,449 @@
+/*
+ * qfexpr.h
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef __QFEXPR_H__
+#define __QFEXPR_H__
+
+#include <cstddef>
+#include <new>
+
+#include <QVariant>
+#include <QAtomicPointer>
+
+#include "qwhere.h"
+#include "qassign.h"
+#include "qfield.h"
+
+/*
+ * Expression templates for filters and assignments. QFE(field) < 3 && QFE(other) == "x"
+ * builds a value of type QFELogical<QFECompare<...>, QFECompare<...>, And>, on the
+ * stack. The number of fields and bound values of an expression is known at compile
+ * time, in its Fields and Binds enums.
+ *
+ * The SQL of an expression type is the same for all its values but the field names
+ * and the bound values. It is written once per type, on first use, as a skeleton of
+ * text with holes. Rendering an expression appends the text of the skeleton and
+ * fills its holes with the operands of the expression, in one loop without virtual
+ * calls.
+ *
+ * An expression converts to QWhere or QAssign, copied in a single node allocated
+ * from the node pool, so that it can be given to QQuerySet::addFilter() or assigned
+ * to a field.
+ */
+
+// String literals are stored as QString
+template<typename T> struct QFEValueType { typedef T Type; };
+template<size_t N> struct QFEValueType<char[N]> { typedef QString Type; };
+
+template<QWhere::Condition Cond> struct QFECondition;
+template<> struct QFECondition<QWhere::Equal> { static const char *str() { return " = "; } };
+template<> struct QFECondition<QWhere::NotEqual> { static const char *str() { return " != "; } };
+template<> struct QFECondition<QWhere::Less> { static const char *str() { return " < "; } };
+template<> struct QFECondition<QWhere::Greater> { static const char *str() { return " > "; } };
+template<> struct QFECondition<QWhere::LessEqual> { static const char *str() { return " <= "; } };
+template<> struct QFECondition<QWhere::GreaterEqual> { static const char *str() { return " >= "; } };
+template<> struct QFECondition<QWhere::And> { static const char *str() { return " AND "; } };
+template<> struct QFECondition<QWhere::Or> { static const char *str() { return " OR "; } };
+
+template<QAssign::Operation Op> struct QFEOperation;
+template<> struct QFEOperation<QAssign::Add> { static const char *str() { return " + "; } };
+template<> struct QFEOperation<QAssign::Sub> { static const char *str() { return " - "; } };
+template<> struct QFEOperation<QAssign::Mul> { static const char *str() { return " * "; } };
+template<> struct QFEOperation<QAssign::Div> { static const char *str() { return " / "; } };
+
+/*
+ * Skeletons and operands
+ */
+
+class QFESkeleton;
+
+// Writes the skeleton of an expression type, the text and where its holes are
+class QFESkeletonWriter
+{
+    public:
+        QFESkeletonWriter(QFESkeleton *skeleton) : _skeleton(skeleton) {}
+
+        QFESkeletonWriter &operator<<(const char *str);
+        QFESkeletonWriter &operator<<(char c);
+
+        void field();       /*!< @brief Hole for the name of a field */
+        void value();       /*!< @brief Hole for a bound value */
+
+    private:
+        QFESkeleton *_skeleton;
+};
+
+// Operands of an expression, in the order of the holes of its skeleton
+struct QFEOperands
+{
+    const QField **fields;
+    QVariant *values;
+    int field_count, value_count;
+
+    void addField(const QField &field) { fields[field_count++] = &field; }
+    void addValue(const QVariant &value) { values[value_count++] = value; }
+};
+
+// Description of an expression type, one static instance per type
+struct QFEType
+{
+    int fields, binds;
+    size_t size;
+    void (*write_skeleton)(QFESkeletonWriter &writer);
+    void (*operands)(const void *e, QFEOperands &operands);
+    void (*copy)(void *to, const void *e);
+    void (*destroy)(void *e);
+    QBasicAtomicPointer<QFESkeleton> skeleton;     // Written on first use
+};
+
+template<typename E>
+struct QFETypeOf
+{
+    static void writeSkeleton(QFESkeletonWriter &writer) { E::writeSkeleton(writer); }
+    static void operands(const void *e, QFEOperands &operands) { static_cast<const E *>(e)->operands(operands); }
+    static void copy(void *to, const void *e) { new (to) E(*static_cast<const E *>(e)); }
+    static void destroy(void *e) { static_cast<E *>(e)->~E(); }
+
+    static QFEType type;
+};
+
+// Constant initialized, usable before the static constructors run
+template<typename E>
+QFEType QFETypeOf<E>::type = {
+    E::Fields, E::Binds, sizeof(E),
+    &QFETypeOf<E>::writeSkeleton, &QFETypeOf<E>::operands, &QFETypeOf<E>::copy, &QFETypeOf<E>::destroy,
+    Q_BASIC_ATOMIC_INITIALIZER(0)
+};
+
+// Nodes holding a copy of the expression, rendered from the skeleton of its type
+QWhere qfeWhere(QFEType &type, const void *e, QWhere::Condition cond);
+QAssign qfeAssign(QFEType &type, const void *e);
+
+/*
+ * Filters
+ */
+
+template<typename D>
+class QFEWhere
+{
+    public:
+        const D &self() const { return static_cast<const D &>(*this); }
+
+        operator QWhere() const { return qfeWhere(QFETypeOf<D>::type, &self(), (QWhere::Condition)D::Condition); }
+};
+
+template<QWhere::Condition Cond, typename T>
+class QFECompare : public QFEWhere<QFECompare<Cond, T> >
+{
+    public:
+        enum { Condition = Cond, Fields = 1, Binds = 1 };
+
+        QFECompare(const QField &f, const T &value) : _f(f), _value(value) {}
+
+        static void writeSkeleton(QFESkeletonWriter &writer)
+        {
+            writer.field();
+            writer << QFECondition<Cond>::str();
+            writer.value();
+        }
+
+        void operands(QFEOperands &operands) const
+        {
+            operands.addField(_f);
+            operands.addValue(QVariant(_value));
+        }
+
+    private:
+        QField _f;
+        T _value;
+};
+
+template<QWhere::Condition Cond>
+class QFEFieldCompare : public QFEWhere<QFEFieldCompare<Cond> >
+{
+    public:
+        enum { Condition = Cond, Fields = 2, Binds = 0 };
+
+        QFEFieldCompare(const QField &left, const QField &right) : _left(left), _right(right) {}
+
+        static void writeSkeleton(QFESkeletonWriter &writer)
+        {
+            writer.field();
+            writer << QFECondition<Cond>::str();
+            writer.field();
+        }
+
+        void operands(QFEOperands &operands) const
+        {
+            operands.addField(_left);
+            operands.addField(_right);
+        }
+
+    private:
+        QField _left;
+        QField _right;
+};
+
+class QFENull : public QFEWhere<QFENull>
+{
+    public:
+        enum { Condition = QWhere::Null, Fields = 1, Binds = 0 };
+
+        QFENull(const QField &f) : _f(f) {}
+
+        static void writeSkeleton(QFESkeletonWriter &writer)
+        {
+            writer.field();
+            writer << " IS NULL";
+        }
+
+        void operands(QFEOperands &operands) const
+        {
+            operands.addField(_f);
+        }
+
+    private:
+        QField _f;
+};
+
+template<typename L, typename R, QWhere::Condition Cond>
+class QFELogical : public QFEWhere<QFELogical<L, R, Cond> >
+{
+    public:
+        enum { Condition = Cond, Fields = L::Fields + R::Fields, Binds = L::Binds + R::Binds };
+
+        QFELogical(const L &left, const R &right) : _left(left), _right(right) {}
+
+        static void writeSkeleton(QFESkeletonWriter &writer)
+        {
+            // Parentheses are only needed around the other logical operator
+            const bool group_left = ((int)L::Condition == QWhere::And || (int)L::Condition == QWhere::Or) &&
+                                    (int)L::Condition != Cond;
+            const bool group_right = ((int)R::Condition == QWhere::And || (int)R::Condition == QWhere::Or) &&
+                                     (int)R::Condition != Cond;
+
+            if (group_left) writer << '(';
+            L::writeSkeleton(writer);
+            if (group_left) writer << ')';
+
+            writer << QFECondition<Cond>::str();
+
+            if (group_right) writer << '(';
+            R::writeSkeleton(writer);
+            if (group_right) writer << ')';
+        }
+
+        void operands(QFEOperands &operands) const
+        {
+            _left.operands(operands);
+            _right.operands(operands);
+        }
+
+    private:
+        L _left;
+        R _right;
+};
+
+template<typename E>
+class QFENot : public QFEWhere<QFENot<E> >
+{
+    public:
+        enum { Condition = QWhere::Not, Fields = E::Fields, Binds = E::Binds };
+
+        QFENot(const E &e) : _e(e) {}
+
+        static void writeSkeleton(QFESkeletonWriter &writer)
+        {
+            writer << "NOT (";
+            E::writeSkeleton(writer);
+            writer << ')';
+        }
+
+        void operands(QFEOperands &operands) const
+        {
+            _e.operands(operands);
+        }
+
+    private:
+        E _e;
+};
+
+template<typename L, typename R>
+inline QFELogical<L, R, QWhere::And> operator&&(const QFEWhere<L> &left, const QFEWhere<R> &right)
+{
+    return QFELogical<L, R, QWhere::And>(left.self(), right.self());
+}
+
+template<typename L, typename R>
+inline QFELogical<L, R, QWhere::Or> operator||(const QFEWhere<L> &left, const QFEWhere<R> &right)
+{
+    return QFELogical<L, R, QWhere::Or>(left.self(), right.self());
+}
+
+template<typename E>
+inline QFENot<E> operator!(const QFEWhere<E> &e)
+{
+    return QFENot<E>(e.self());
+}
+
+// Mixing with runtime filters
+template<typename L>
+inline QWhere operator&&(const QFEWhere<L> &left, const QWhere &right)
+{
+    return QWhere(left) && right;
+}
+
+template<typename L>
+inline QWhere operator||(const QFEWhere<L> &left, const QWhere &right)
+{
+    return QWhere(left) || right;
+}
+
+/*
+ * Assignments
+ */
+
+template<typename D>
+class QFEAssign
+{
+    public:
+        const D &self() const { return static_cast<const D &>(*this); }
+
+        operator QAssign() const { return qfeAssign(QFETypeOf<D>::type, &self()); }
+};
+
+template<typename T>
+class QFEValue : public QFEAssign<QFEValue<T> >
+{
+    public:
+        enum { Fields = 0, Binds = 1 };
+
+        QFEValue(const T &value) : _value(value) {}
+
+        static void writeSkeleton(QFESkeletonWriter &writer) { writer.value(); }
+
+        void operands(QFEOperands &operands) const { operands.addValue(QVariant(_value)); }
+
+    private:
+        T _value;
+};
+
+// Right operand of an operation, a value unless it is already an expression
+template<typename T>
+struct QFEOperand
+{
+    typedef QFEValue<typename QFEValueType<T>::Type> Type;
+    static Type make(const T &value) { return Type(value); }
+};
+
+template<typename L, typename R, QAssign::Operation Op>
+class QFEArithmetic : public QFEAssign<QFEArithmetic<L, R, Op> >
+{
+    public:
+        enum { Fields = L::Fields + R::Fields, Binds = L::Binds + R::Binds };
+
+        QFEArithmetic(const L &left, const R &right) : _left(left), _right(right) {}
+
+        static void writeSkeleton(QFESkeletonWriter &writer)
+        {
+            writer << '(';
+            L::writeSkeleton(writer);
+            writer << QFEOperation<Op>::str();
+            R::writeSkeleton(writer);
+            writer << ')';
+        }
+
+        void operands(QFEOperands &operands) const
+        {
+            _left.operands(operands);
+            _right.operands(operands);
+        }
+
+    private:
+        L _left;
+        R _right;
+};
+
+template<typename L, typename R, QAssign::Operation Op>
+struct QFEOperand<QFEArithmetic<L, R, Op> >
+{
+    typedef QFEArithmetic<L, R, Op> Type;
+    static const Type &make(const Type &e) { return e; }
+};
+
+#define _Q_FE_ARITHMETIC(op, Op) \
+    template<typename L, typename T> \
+    inline QFEArithmetic<L, typename QFEOperand<T>::Type, QAssign::Op> operator op(const QFEAssign<L> &left, const T &right) \
+    { return QFEArithmetic<L, typename QFEOperand<T>::Type, QAssign::Op>(left.self(), QFEOperand<T>::make(right)); }
+
+_Q_FE_ARITHMETIC(+, Add)
+_Q_FE_ARITHMETIC(-, Sub)
+_Q_FE_ARITHMETIC(*, Mul)
+_Q_FE_ARITHMETIC(/, Div)
+
+#undef _Q_FE_ARITHMETIC
+
+/*
+ * Entry point, QFE(field)
+ */
+
+#define _Q_FE_COMPARE(op, Cond) \
+    template<typename T> \
+    QFECompare<QWhere::Cond, typename QFEValueType<T>::Type> operator op(const T &value) const \
+    { return QFECompare<QWhere::Cond, typename QFEValueType<T>::Type>(_f, value); } \
+    QFEFieldCompare<QWhere::Cond> operator op(const QFE &other) const \
+    { return QFEFieldCompare<QWhere::Cond>(_f, other._f); }
+
+class QFE : public QFEAssign<QFE>
+{
+    public:
+        enum { Fields = 1, Binds = 0 };
+
+        QFE(const QField &f) : _f(f) {}
+
+        static void writeSkeleton(QFESkeletonWriter &writer) { writer.field(); }
+
+        void operands(QFEOperands &operands) const { operands.addField(_f); }
+
+        _Q_FE_COMPARE(==, Equal)
+        _Q_FE_COMPARE(!=, NotEqual)
+        _Q_FE_COMPARE(<, Less)
+        _Q_FE_COMPARE(>, Greater)
+        _Q_FE_COMPARE(<=, LessEqual)
+        _Q_FE_COMPARE(>=, GreaterEqual)
+
+        QFENull isNull() const { return QFENull(_f); }
+
+    private:
+        QField _f;
+};
+
+template<>
+struct QFEOperand<QFE>
+{
+    typedef QFE Type;
+    static const QFE &make(const QFE &f) { return f; }
+};
+
+#undef _Q_FE_COMPARE
+
+#endif
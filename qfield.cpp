@@ -23,39 +23,194 @@
 #include "qfield.h"
 #include "qfield_p.h"
 #include "qmodel.h"
+#include "qtormdatabase.h"
+#include "qsqlwriter_p.h"
 
 #include <assert.h>
 
 #include <QtSql>
+#include <QtDebug>
 
 uint qHash(const QField &field)
 {
     return qHash(field.d);
 }
 
+/*
+ * QFieldSchema
+ */
+
+QFieldSchema::QFieldSchema(const QString &name)
+ : name(name), accepts_null(false), auto_increment(false), primary_key(false), shared(false),
+   target_factory(NULL), escapes(NULL)
+{
+}
+
+QFieldSchema::QFieldSchema(const QFieldSchema &other)
+ : name(other.name), accepts_null(other.accepts_null), auto_increment(other.auto_increment),
+   primary_key(other.primary_key), shared(false), target_factory(other.target_factory), escapes(NULL)
+{
+}
+
+QFieldSchema::~QFieldSchema()
+{
+    QFieldEscapes *current = escapes;
+
+    while (current)
+    {
+        QFieldEscapes *previous = current->previous;
+
+        delete current;
+        current = previous;
+    }
+}
+
+static const QString *findEscapedName(const QFieldEscapes *escapes, const char *driver, int tableNumber)
+{
+    if (!escapes)
+        return NULL;
+
+    for (int i=0; i<escapes->drivers.count(); ++i)
+    {
+        const QFieldEscapes::Names &names = escapes->drivers.at(i);
+
+        if (names.driver != driver)
+            continue;
+
+        if (tableNumber < 0)
+            return &names.name;
+
+        if (tableNumber < names.field_names.count() && !names.field_names.at(tableNumber).isNull())
+            return &names.field_names.at(tableNumber);
+
+        return NULL;
+    }
+
+    return NULL;
+}
+
+const QString &QFieldSchema::escapedName(QSqlDriver *driver, int tableNumber)
+{
+    const char *type = QtOrmDatabase::driverType(driver);
+
+    for (;;)
+    {
+        QFieldEscapes *current = escapes;
+        const QString *rs = findEscapedName(current, type, tableNumber);
+
+        if (rs)
+            return *rs;
+
+        // Publish a copy knowing this name, the instances of other threads may be doing the same
+        QFieldEscapes *copy = (current ? new QFieldEscapes(*current) : new QFieldEscapes);
+        int index = 0;
+
+        while (index < copy->drivers.count() && copy->drivers.at(index).driver != type)
+            ++index;
+
+        if (index == copy->drivers.count())
+        {
+            QFieldEscapes::Names names;
+
+            names.driver = type;
+            names.name = driver->escapeIdentifier(name, QSqlDriver::FieldName);
+            copy->drivers.append(names);
+        }
+
+        if (tableNumber >= 0)
+        {
+            QVector<QString> &field_names = copy->drivers[index].field_names;
+
+            if (field_names.count() <= tableNumber)
+                field_names.resize(tableNumber + 1);
+
+            field_names[tableNumber] = driver->escapeIdentifier(
+                QString("T%0.%1").arg(tableNumber).arg(name), QSqlDriver::FieldName);
+        }
+
+        copy->previous = current;
+
+        if (escapes.testAndSetOrdered(current, copy))
+            return *findEscapedName(copy, type, tableNumber);
+
+        copy->previous = NULL;
+        delete copy;
+    }
+}
+
 /*
  * QFieldPrivate
  */
 
 QFieldPrivate::QFieldPrivate(QModel *model, const QString &name)
  : _model(model),
-   _name(name),
+   _schema(model ? model->sharedFieldSchema(name) : NULL),
+   _row(model ? model->row() : new QModelRow),
+   _offset(0),
    _refcount(1),
-   _isnull(true),
-   _accepts_null(false),
-   _auto_increment(false),
-   _primary_key(false),
-   _modified(false)
+   _loader(NULL)
 {
+    // First instance of the model, or a field not known by its schema
+    if (!_schema)
+        _schema = new QFieldSchema(name);
+
+    if (model)
+        _row->ref();
 }
 
 QFieldPrivate::~QFieldPrivate()
 {
+    if (!_schema->shared)
+        delete _schema;
+}
+
+void *QFieldPrivate::operator new(size_t size, QModel *model)
+{
+    if (!model)
+        return ::operator new(size);
+
+    return model->allocateField(size);
+}
+
+void QFieldPrivate::operator delete(void *ptr, QModel *model)
+{
+    // Constructor that failed, the memory of a row is freed with it
+    if (!model)
+        ::operator delete(ptr);
+}
+
+void QFieldPrivate::operator delete(void *ptr)
+{
+    ::operator delete(ptr);
+}
+
+void QFieldPrivate::release(QFieldPrivate *field)
+{
+    QModelRow *row = field->_row;
+    bool on_heap = (field->_model == NULL);
+
+    // The row owns the memory of the field, it must outlive its destructor
+    field->~QFieldPrivate();
+
+    if (on_heap)
+        ::operator delete(field);
+
+    if (!row->deref())
+        delete row;
+}
+
+void QFieldPrivate::detachSchema()
+{
+    if (_schema->shared)
+    {
+        _schema = new QFieldSchema(*_schema);
+        _schema->shared = false;
+    }
 }
 
 QString QFieldPrivate::name() const
 {
-    return _name;
+    return _schema->name;
 }
 
 QModel *QFieldPrivate::model() const
@@ -63,59 +218,189 @@ QModel *QFieldPrivate::model() const
     return _model;
 }
 
+QFieldSchema *QFieldPrivate::schema() const
+{
+    return _schema;
+}
+
 bool QFieldPrivate::isForeignKey() const
 {
     return false;
 }
 
+bool QFieldPrivate::integerValue(qlonglong &value) const
+{
+    (void)value;
+
+    return false;
+}
+
 bool QFieldPrivate::isNull() const
 {
-    return _isnull;
+    return (_row->flags(_offset) & QModelRow::Null);
 }
 
 void QFieldPrivate::setNull(bool isnull)
 {
-    _isnull = isnull;
+    if (isnull)
+        _row->flags(_offset) |= QModelRow::Null;
+    else
+        _row->flags(_offset) &= ~QModelRow::Null;
 }
 
 void QFieldPrivate::setModified(bool modified)
 {
-    _modified = modified;
+    // A value set by the user replaces the one not loaded from the database,
+    // and is not in the update batch yet
+    if (modified)
+        _row->flags(_offset) = (_row->flags(_offset) | QModelRow::Modified) & ~(QModelRow::Unloaded | QModelRow::Batched);
+    else
+        _row->flags(_offset) &= ~(QModelRow::Modified | QModelRow::Batched);
 }
 
 bool QFieldPrivate::isModified() const
 {
-    return _modified;
+    return (_row->flags(_offset) & QModelRow::Modified);
+}
+
+void QFieldPrivate::setBatched(bool batched)
+{
+    if (batched)
+        _row->flags(_offset) |= QModelRow::Batched;
+    else
+        _row->flags(_offset) &= ~QModelRow::Batched;
+}
+
+bool QFieldPrivate::isBatched() const
+{
+    return (_row->flags(_offset) & QModelRow::Batched);
+}
+
+bool QFieldPrivate::isLazy() const
+{
+    return false;
+}
+
+void QFieldPrivate::setLoaded(bool loaded)
+{
+    if (loaded)
+    {
+        _row->flags(_offset) &= ~QModelRow::Unloaded;
+    }
+    else
+    {
+        // The value in the database is the reference, nothing to save
+        _row->flags(_offset) |= QModelRow::Unloaded;
+        _row->flags(_offset) &= ~QModelRow::Modified;
+    }
+}
+
+void QFieldPrivate::setLoader(QFieldLoader *loader)
+{
+    _loader = loader;
+}
+
+QFieldLoader *QFieldPrivate::loader() const
+{
+    return _loader;
+}
+
+bool QFieldPrivate::load()
+{
+    if (_row->flags(_offset) & QModelRow::Unread)
+    {
+        _row->flags(_offset) &= ~QModelRow::Unread;
+
+        if (_loader)
+            _loader->fieldRead(this);
+    }
+
+    if (isLoaded())
+        return true;
+
+    if (_loader && _loader->loadField(this))
+    {
+        setLoaded(true);
+        return true;
+    }
+
+    // A model not saved yet has nothing to load
+    const QField &pk = _model->pk();
+
+    if (pk.isNull())
+    {
+        setLoaded(true);
+        return true;
+    }
+
+    QSqlDatabase db = QtOrmDatabase::threadDatabase();
+    QSqlQuery query(db);
+    QSqlWriter writer(db.driver());
+
+    writer << "SELECT " << escapedName(db.driver()) << " FROM ";
+    writer.appendTableName(_model);
+    writer << " WHERE ";
+    writer.appendName(pk);
+    writer << '=';
+    writer.appendValue(pk.data());
+    writer << ';';
+
+    query.prepare(writer.sql());
+    query.addBindValue(writer.values().at(0));
+
+    // Left unloaded on failure, the next access tries again
+    if (!QtOrmDatabase::exec(db, query, writer.sql(), writer.values(), QtOrmInstrumentation::Select, _model->tableName()) ||
+        !query.next())
+    {
+        qDebug() << "Could not load field" << name() << ":" << query.lastError();
+        return false;
+    }
+
+    setLoaded(true);
+    fromData(query.value(0));
+    return true;
 }
 
 void QFieldPrivate::setAcceptsNull(bool null)
 {
-    _accepts_null = null;
+    if (_schema->accepts_null == null)
+        return;
+
+    detachSchema();
+    _schema->accepts_null = null;
 }
 
 bool QFieldPrivate::acceptsNull() const
 {
-    return _accepts_null;
+    return _schema->accepts_null;
 }
 
 void QFieldPrivate::setAutoIncrement(bool autoincrement)
 {
-    _auto_increment = autoincrement;
+    if (_schema->auto_increment == autoincrement)
+        return;
+
+    detachSchema();
+    _schema->auto_increment = autoincrement;
 }
 
 bool QFieldPrivate::autoIncrement() const
 {
-    return _auto_increment;
+    return _schema->auto_increment;
 }
 
 void QFieldPrivate::setPrimaryKey(bool primarykey)
 {
-    _primary_key = primarykey;
+    if (_schema->primary_key == primarykey)
+        return;
+
+    detachSchema();
+    _schema->primary_key = primarykey;
 }
 
 bool QFieldPrivate::primaryKey() const
 {
-    return _primary_key;
+    return _schema->primary_key;
 }
 
 void QFieldPrivate::setAssignation(const QAssign &assignation)
@@ -128,6 +413,16 @@ QAssign QFieldPrivate::assignation() const
     return _assignation;
 }
 
+const QString &QFieldPrivate::escapedName(QSqlDriver *driver)
+{
+    return _schema->escapedName(driver, -1);
+}
+
+const QString &QFieldPrivate::escapedFieldName(QSqlDriver *driver, int tableNumber)
+{
+    return _schema->escapedName(driver, tableNumber);
+}
+
 QString QFieldPrivate::commonSqlDescription() const
 {
     QString rs;
@@ -181,19 +476,19 @@ QField::QField(const QField &other) : d(other.d)
 QField::~QField()
 {
     if (d && !d->deref())
-        delete d;
+        QFieldPrivate::release(d);
 }
 
 QField &QField::operator=(const QField &other)
 {
+    if (other.d)
+        other.d->ref();
+
     if (d && !d->deref())
-        delete d;
+        QFieldPrivate::release(d);
 
     d = other.d;
 
-    if (d)
-        d->ref();
-
     return *this;
 }
 
@@ -219,6 +514,8 @@ void QField::setNull(bool null)
 
 bool QField::isNull() const
 {
+    d->ensureLoaded();
+
     return d->isNull();
 }
 
@@ -264,14 +561,24 @@ bool QField::primaryKey() const
 
 void QField::setRawData(const QVariant &data)
 {
+    if (!d->isLoaded())
+        d->setLoaded(true);
+
     d->fromData(data);
 }
 
 QVariant QField::data() const
 {
+    d->ensureLoaded();
+
     return d->data();
 }
 
+QString QField::sqlType() const
+{
+    return d->sqlType();
+}
+
 QString QField::sqlDescription() const
 {
     return d->sqlDescription();
@@ -284,6 +591,16 @@ QString QField::fieldName() const
     return QString("T%0.%1").arg(tableNumber).arg(d->name());
 }
 
+const QString &QField::escapedName(QSqlDriver *driver) const
+{
+    return d->escapedName(driver);
+}
+
+const QString &QField::escapedFieldName(QSqlDriver *driver) const
+{
+    return d->escapedFieldName(driver, d->model()->tableNumber());
+}
+
 void QField::setAssignation(const QAssign &assignation)
 {
     setModified(true);
@@ -30,10 +30,13 @@
 
 class QModel;
 class QFieldPrivate;
+class QSqlDriver;
 class QWherePrivate;
 class QAssignPrivate;
 class QQuerySetPrivate;
 class QForeignKeyPrivate;
+class QBatchRemove;
+class QSqlWriter;
 
 #define _Q_F_ASSIGN(T) T &operator=(const QAssign &a) { setAssignation(a); return *this; }
 
@@ -44,6 +47,9 @@ class QField
     friend class QAssignPrivate;
     friend class QQuerySetPrivate;
     friend class QForeignKeyPrivate;
+    friend class QBatchRemove;
+    friend class QSqlWriter;
+    friend class QF;
 
     public:
         QField();
@@ -97,8 +103,11 @@ class QField
 
         QModel *model() const;
 
+        QString sqlType() const;
         QString sqlDescription() const;
         QString fieldName() const;
+        const QString &escapedName(QSqlDriver *driver) const;
+        const QString &escapedFieldName(QSqlDriver *driver) const;
         QAssign assignation() const;
 
     protected:
@@ -110,6 +119,13 @@ class QField
 
 Q_DECLARE_TYPEINFO(QField, Q_MOVABLE_TYPE);
 
+// C++ type of the values of a field class, void if it is not known
+template<typename F>
+struct QFieldTraits
+{
+    typedef void ValueType;
+};
+
 uint qHash(const QField &field);
 
 #endif
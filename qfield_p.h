@@ -25,21 +25,96 @@
 
 #include <QString>
 #include <QVariant>
+#include <QByteArray>
+#include <QVector>
+#include <QAtomicPointer>
 
 #include "qassign.h"
+#include "qmodelrow_p.h"
 
+class QSqlDriver;
+class QFieldPrivate;
+class QModel;
+
+/*
+ * Loads the value of an unloaded field, for instance along with the same field
+ * of other rows. A loader returning false lets the field load itself alone.
+ * The loader can also be told of the first read of a field marked unread.
+ */
+class QFieldLoader
+{
+    public:
+        virtual ~QFieldLoader() {}
+
+        virtual bool loadField(QFieldPrivate *field) = 0;
+        virtual void fieldRead(QFieldPrivate *field) { (void)field; }
+};
+
+/*
+ * Identifiers of a field escaped by the drivers used so far, bare and qualified
+ * by the table numbers. Never modified once published, a new driver or table
+ * number publishes a copy.
+ */
+struct QFieldEscapes
+{
+    struct Names
+    {
+        QByteArray driver;              // QtOrmDatabase::driverType()
+        QString name;
+        QVector<QString> field_names;   // By table number
+    };
+
+    QVector<Names> drivers;
+    QFieldEscapes *previous;            // Replaced, but maybe still read
+};
+
+/*
+ * Description of a field shared by all the instances of a model, once the
+ * first instance is initialized. A shared schema is never modified nor freed,
+ * a field that changes it gets its own copy.
+ */
+struct QFieldSchema
+{
+    typedef QModel *(*TargetFactory)();
+
+    QFieldSchema(const QString &name);
+    QFieldSchema(const QFieldSchema &other);
+    ~QFieldSchema();
+
+    const QString &escapedName(QSqlDriver *driver, int tableNumber);     // Bare name if tableNumber is -1
+
+    QString name;
+    bool accepts_null, auto_increment, primary_key;
+    bool shared;
+    TargetFactory target_factory;       // Target model of a foreign key
+
+    QAtomicPointer<QFieldEscapes> escapes;
+};
+
+/*
+ * The fields of a model are allocated in its row, with new (model), and freed
+ * with release(). Those created without a model are on the heap.
+ */
 class QFieldPrivate
 {
     public:
         QFieldPrivate(QModel *model, const QString &name);
         virtual ~QFieldPrivate();
 
+        static void *operator new(size_t size, QModel *model);
+        static void operator delete(void *ptr, QModel *model);
+        static void operator delete(void *ptr);     // Only on the heap, use release()
+        static void release(QFieldPrivate *field);
+
         QString name() const;
         QModel *model() const;
+        QFieldSchema *schema() const;
         bool isNull() const;
         void setNull(bool isnull);
         void setModified(bool modified);
         bool isModified() const;
+        void setBatched(bool batched);
+        bool isBatched() const;
         void setAcceptsNull(bool null);
         bool acceptsNull() const;
         void setAutoIncrement(bool autoincrement);
@@ -49,24 +124,68 @@ class QFieldPrivate
         void setAssignation(const QAssign &assignation);
         QAssign assignation() const;
 
+        const QString &escapedName(QSqlDriver *driver);
+        const QString &escapedFieldName(QSqlDriver *driver, int tableNumber);
+
         virtual void fromData(const QVariant &data) = 0;
         virtual QVariant data() const = 0;
+        virtual QString sqlType() const = 0;
         virtual QString sqlDescription() const = 0;
 
         virtual bool isForeignKey() const;
+        virtual bool integerValue(qlonglong &value) const;     // False if not an integer, or null
+
+        // Lazy fields are not fetched with the rows, but on first access
+        virtual bool isLazy() const;
+        virtual void setLoaded(bool loaded);
+        void setLoader(QFieldLoader *loader);
+        QFieldLoader *loader() const;
+        bool load();
+
+        inline bool isLoaded() const
+        {
+            return !(_row->flags(_offset) & QModelRow::Unloaded);
+        }
+
+        inline void ensureLoaded() const
+        {
+            if (_row->flags(_offset) & (QModelRow::Unloaded | QModelRow::Unread))
+                const_cast<QFieldPrivate *>(this)->load();
+        }
+
+        inline void watchRead()
+        {
+            _row->flags(_offset) |= QModelRow::Unread;
+        }
 
         void ref();
         bool deref();
 
     protected:
         QString commonSqlDescription() const;
+        void detachSchema();
+
+        // Value of the field, in the row of its model
+        template<typename T>
+        void allocateValue(const T &value)
+        {
+            _offset = _row->allocate(value);
+        }
+
+        template<typename T>
+        inline T &rowValue() const
+        {
+            return _row->value<T>(_offset);
+        }
 
     protected:
         QModel *_model;
-        QString _name;
+        QFieldSchema *_schema;
+        QModelRow *_row;
+        int _offset;
         unsigned int _refcount;
-        bool _isnull, _accepts_null, _auto_increment, _primary_key, _modified;
         QAssign _assignation;
+        QFieldLoader *_loader;
 };
 
 #endif
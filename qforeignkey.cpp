@@ -24,15 +24,16 @@
 #include "qforeignkey_p.h"
 #include "qmodel.h"
 #include "qqueryset.h"
+#include "qtorminstrumentation.h"
 
 #include <QtDebug>
 
 QForeignKeyPrivate::QForeignKeyPrivate(QModel *model, const QString &name)
  : QFieldPrivate(model, name),
    _value(NULL),
-   _id(QVariant(QVariant::Int)),
    _delete_value(true)
 {
+    allocateValue<QForeignKeyId>(QForeignKeyId());
 }
 
 QForeignKeyPrivate::~QForeignKeyPrivate()
@@ -61,36 +62,69 @@ void QForeignKeyPrivate::setDeleteValue(bool enable)
     _delete_value = enable;
 }
 
+void QForeignKeyPrivate::setFactory(Factory factory)
+{
+    // The same for all the instances, kept in the schema
+    if (_schema->target_factory == factory)
+        return;
+
+    detachSchema();
+    _schema->target_factory = factory;
+}
+
+QModel *QForeignKeyPrivate::createTarget() const
+{
+    // The value of this field is left untouched
+    if (!_schema->target_factory)
+        return NULL;
+
+    return _schema->target_factory();
+}
+
 void QForeignKeyPrivate::fillCache() const
 {
-    if (_id.isNull())
+    if (isNull())
         return;
 
+    // Counted by the query set being iterated, if watched
+    QQuerySet::foreignKeyLoaded(this, _value);
+
+    bool instrumented = QtOrmInstrumentation::isEnabled();
+    qint64 start = (instrumented ? QtOrmInstrumentation::timestamp() : 0);
+
     // Fill the value model with data from the database
     QQuerySet query(_value);
 
-    query.addFilter(QF(_value->pk()) == _id);
+    query.addFilter(QF(_value->pk()) == data());
     query.next();
 
     _value->resetModified();
+
+    if (instrumented)
+        QtOrmInstrumentation::record(QtOrmInstrumentation::FillCache, QtOrmInstrumentation::Select, _value->tableName(), QString(), start, 1);
 }
 
 void QForeignKeyPrivate::setValue(QModel *value)
 {
+    bool had_id = !isNull();
+    QVariant pk = value->pk().data();
+
     setNull(false); // The field is not null anymore
     setModified(true);
 
     deleteValue();
 
-    // Update our current child model ID
+    // Update our current child model ID, there is still no ID if the model is not saved
     _value = value;
-    if (!value->pk().data().isNull())
-        _id = value->pk().data();
+    if (!pk.isNull())
+        setKey(pk);
+    else if (!had_id)
+        setNull(true);
 }
 
 void QForeignKeyPrivate::setValue(const QVariant &data)
 {
-    _id = data;
+    setKey(data);
     setNull(data.isNull());
     setModified(true);
 
@@ -101,19 +135,97 @@ void QForeignKeyPrivate::setValue(const QVariant &data)
 
 void QForeignKeyPrivate::fromData(const QVariant &data)
 {
-    _id = data;
+    setKey(data);
     setNull(data.isNull());
     setModified(false);
 }
 
+void QForeignKeyPrivate::setKey(const QVariant &data)
+{
+    QForeignKeyId &key = rowValue<QForeignKeyId>();
+
+    switch (data.type())
+    {
+        case QVariant::Int:
+        case QVariant::UInt:
+        case QVariant::LongLong:
+        case QVariant::ULongLong:
+            key.number = data.toLongLong();
+            key.other = QVariant();
+            break;
+        default:
+            key.number = 0;
+            key.other = data;
+            break;
+    }
+}
+
 QVariant QForeignKeyPrivate::data() const
 {
-    return _id;
+    if (isNull())
+        return QVariant(QVariant::Int);
+
+    const QForeignKeyId &key = rowValue<QForeignKeyId>();
+
+    if (key.other.isValid())
+        return key.other;
+
+    return QVariant(key.number);
+}
+
+qlonglong QForeignKeyPrivate::id() const
+{
+    ensureLoaded();
+
+    if (isNull())
+        return 0;
+
+    const QForeignKeyId &key = rowValue<QForeignKeyId>();
+
+    if (key.other.isValid())
+        return key.other.toLongLong();
+
+    return key.number;
+}
+
+bool QForeignKeyPrivate::isKeyOf(const QModel *target) const
+{
+    const QField &pk = target->pk();
+    const QForeignKeyId &key = rowValue<QForeignKeyId>();
+    qlonglong number;
+
+    if (pk.isNull())
+        return false;
+
+    // Integer keys are compared without QVariant
+    if (!key.other.isValid() && pk.d->integerValue(number))
+        return (number == key.number);
+
+    return (pk.data() == data());
+}
+
+void QForeignKeyPrivate::setId(qlonglong id)
+{
+    QForeignKeyId &key = rowValue<QForeignKeyId>();
+
+    key.number = id;
+    key.other = QVariant();
+    setNull(false);
+    setModified(true);
+
+    deleteValue();
+
+    _value = NULL;
+}
+
+QString QForeignKeyPrivate::sqlType() const
+{
+    return QLatin1String("INTEGER");
 }
 
 QString QForeignKeyPrivate::sqlDescription() const
 {
-    QString rs = QLatin1String("INTEGER");
+    QString rs = sqlType();
 
     rs += commonSqlDescription();
 
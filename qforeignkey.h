@@ -41,6 +41,8 @@ class QForeignKey : public QField
         QForeignKey &operator=(const QVariant &value);
         T *value() const;
         T *operator->() const;
+        qlonglong id() const;       /*!< @brief Numeric primary key of the target, read without loading it. Use data() for other key types */
+        void setId(qlonglong id);
 
         void setDelegate(T *model);    /*!< @brief Define a model that will contain the target data of this foreign key, instead of a default one instanced as needed */
 
@@ -48,6 +50,7 @@ class QForeignKey : public QField
 
     private:
         T *checkValue() const;
+        static QModel *createTarget();
 
     private:
         QForeignKeyPrivate *dptr() const;
@@ -56,6 +59,12 @@ class QForeignKey : public QField
 template<typename T>
 Q_DECLARE_TYPEINFO_BODY(QForeignKey<T>, Q_MOVABLE_TYPE);
 
+template<typename T>
+struct QFieldTraits<QForeignKey<T> >
+{
+    typedef void ValueType;     // Keys can be of any type
+};
+
 template<typename T>
 QForeignKey<T>::QForeignKey() : QField(NULL)
 {
@@ -63,8 +72,9 @@ QForeignKey<T>::QForeignKey() : QField(NULL)
 
 template<typename T>
 QForeignKey<T>::QForeignKey(QModel *model, const QString &name)
-: QField(new QForeignKeyPrivate(model, name))
+: QField(new (model) QForeignKeyPrivate(model, name))
 {
+    dptr()->setFactory(&QForeignKey<T>::createTarget);
 }
 
 template<typename T>
@@ -79,6 +89,18 @@ QForeignKey<T> &QForeignKey<T>::operator=(const QVariant &value)
     return *this;
 }
 
+template<typename T>
+qlonglong QForeignKey<T>::id() const
+{
+    return dptr()->id();
+}
+
+template<typename T>
+void QForeignKey<T>::setId(qlonglong id)
+{
+    dptr()->setId(id);
+}
+
 template<typename T>
 void QForeignKey<T>::setDelegate(T *model)
 {
@@ -106,14 +128,22 @@ T *QForeignKey<T>::checkValue() const
     return rs;
 }
 
+template<typename T>
+QModel *QForeignKey<T>::createTarget()
+{
+    return new T;
+}
+
 template<typename T>
 T *QForeignKey<T>::value() const
 {
     T *rs = checkValue();
 
-    if (!dptr()->data().isNull())
+    dptr()->ensureLoaded();
+
+    if (!dptr()->isNull())
     {
-        if (rs->pk().isNull() || rs->pk().data() != dptr()->data())
+        if (!dptr()->isKeyOf(rs))
         {
             // Need to fill the cache
             dptr()->fillCache();
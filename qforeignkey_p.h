@@ -27,20 +27,37 @@
 
 class QModel;
 
+// Key of the target, typed for the integer keys, the others are kept as read
+struct QForeignKeyId
+{
+    QForeignKeyId() : number(0) {}
+
+    qlonglong number;
+    QVariant other;     // Invalid if the key is an integer
+};
+
 class QForeignKeyPrivate : public QFieldPrivate
 {
     public:
+        typedef QFieldSchema::TargetFactory Factory;
+
         QForeignKeyPrivate(QModel *model, const QString &name);
         ~QForeignKeyPrivate();
 
         void setValue(QModel *value);
         void setValue(const QVariant &value);
+        qlonglong id() const;
+        bool isKeyOf(const QModel *target) const;  // Whether target is the model this key points to
+        void setId(qlonglong id);
         QModel *value();
         void setDeleteValue(bool enable);
+        void setFactory(Factory factory);
+        QModel *createTarget() const;       // New instance of the target model, owned by the caller
         void fillCache() const;
 
         void fromData(const QVariant &data);
         QVariant data() const;
+        QString sqlType() const;
         QString sqlDescription() const;
 
         bool isForeignKey() const;
@@ -48,10 +65,10 @@ class QForeignKeyPrivate : public QFieldPrivate
 
     private:
         void deleteValue();
+        void setKey(const QVariant &data);
 
     private:
         QModel *_value;
-        QVariant _id;
         bool _delete_value;
 };
 
@@ -0,0 +1,251 @@
+/*
+ * qindexadvisor.cpp
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "qindexadvisor.h"
+#include "qtormdatabase.h"
+
+#include <QtSql>
+#include <QtDebug>
+#include <QHash>
+#include <QMutex>
+#include <QtAlgorithms>
+
+struct Usage
+{
+    QIndexAdvisor::AccessPath path;
+    qint64 count;
+    qint64 usecs;
+};
+
+static bool advisor_enabled = false;
+static QMutex usages_mutex;
+static QHash<QString, Usage> usages;    // Keyed by table and columns
+
+static bool heavier(const Usage &a, const Usage &b)
+{
+    if (a.usecs != b.usecs)
+        return a.usecs > b.usecs;
+
+    return a.count > b.count;
+}
+
+void QIndexAdvisor::setEnabled(bool enabled)
+{
+    advisor_enabled = enabled;
+}
+
+bool QIndexAdvisor::isEnabled()
+{
+    return advisor_enabled;
+}
+
+void QIndexAdvisor::clear()
+{
+    QMutexLocker locker(&usages_mutex);
+
+    usages.clear();
+}
+
+void QIndexAdvisor::record(const QList<AccessPath> &paths, qint64 usecs)
+{
+    QMutexLocker locker(&usages_mutex);
+
+    for (int i=0; i<paths.count(); ++i)
+    {
+        const AccessPath &path = paths.at(i);
+        QString key = path.table + QLatin1Char(':') + path.columns.join(QLatin1String(","));
+        QHash<QString, Usage>::iterator it = usages.find(key);
+
+        if (it == usages.end())
+        {
+            Usage usage;
+
+            usage.path = path;
+            usage.count = 0;
+            usage.usecs = 0;
+            it = usages.insert(key, usage);
+        }
+
+        it.value().count++;
+        it.value().usecs += usecs;
+    }
+}
+
+QList<QStringList> QIndexAdvisor::indexes(const QSqlDatabase &db, const QString &table)
+{
+    QSqlDriver *driver = db.driver();
+    QString escaped_table = driver->escapeIdentifier(table, QSqlDriver::TableName);
+    QList<QStringList> rs;
+    QSqlQuery query(db);
+
+    switch (QtOrmDatabase::dialect(db))
+    {
+        case QtOrmDatabase::SQLite:
+        {
+            if (!query.exec(QString("PRAGMA index_list(%1);").arg(escaped_table)))
+                break;
+
+            while (query.next())
+            {
+                QSqlQuery info(db);
+                QStringList columns;
+
+                info.exec(QString("PRAGMA index_info(%1);").arg(
+                    driver->escapeIdentifier(query.value(1).toString(), QSqlDriver::TableName)));
+
+                // seqno, cid, name
+                while (info.next())
+                    columns.append(info.value(2).toString());
+
+                rs.append(columns);
+            }
+            break;
+        }
+        case QtOrmDatabase::PostgreSQL:
+        {
+            query.prepare("SELECT indexdef FROM pg_indexes WHERE tablename = ?;");
+            query.addBindValue(table);
+
+            if (!query.exec())
+                break;
+
+            while (query.next())
+            {
+                // CREATE INDEX name ON table USING btree (a, b) [WHERE ...]
+                QString def = query.value(0).toString();
+                int open = def.indexOf(QLatin1Char('('), def.indexOf(QLatin1String(" USING ")));
+                int close = def.indexOf(QLatin1Char(')'), open);
+                QStringList columns = def.mid(open + 1, close - open - 1).split(QLatin1String(", "));
+
+                for (int i=0; i<columns.count(); ++i)
+                    columns[i] = columns.at(i).section(QLatin1Char(' '), 0, 0).remove(QLatin1Char('"'));
+
+                rs.append(columns);
+            }
+            break;
+        }
+        case QtOrmDatabase::MySQL:
+        {
+            if (!query.exec(QString("SHOW INDEX FROM %1;").arg(escaped_table)))
+                break;
+
+            // Key_name, Seq_in_index and Column_name, ordered by key
+            QString key;
+
+            while (query.next())
+            {
+                if (rs.count() == 0 || query.value(2).toString() != key)
+                {
+                    key = query.value(2).toString();
+                    rs.append(QStringList());
+                }
+
+                rs.last().append(query.value(4).toString());
+            }
+            break;
+        }
+        default:
+            // Unknown catalog, every access path is recommended
+            break;
+    }
+
+    return rs;
+}
+
+bool QIndexAdvisor::covers(const QStringList &index, const AccessPath &path)
+{
+    if (index.count() < path.columns.count())
+        return false;
+
+    // The equality columns can be in any order, the range column must follow them
+    QStringList index_equalities = index.mid(0, path.equalities);
+    QStringList path_equalities = path.columns.mid(0, path.equalities);
+
+    qSort(index_equalities);
+
+    if (index_equalities != path_equalities)
+        return false;
+
+    for (int i=path.equalities; i<path.columns.count(); ++i)
+    {
+        if (index.at(i) != path.columns.at(i))
+            return false;
+    }
+
+    return true;
+}
+
+QStringList QIndexAdvisor::recommendations(int count)
+{
+    QList<Usage> list;
+
+    usages_mutex.lock();
+    list = usages.values();
+    usages_mutex.unlock();
+
+    qSort(list.begin(), list.end(), heavier);
+
+    QSqlDatabase db = QtOrmDatabase::threadDatabase();
+    QSqlDriver *driver = db.driver();
+    QHash<QString, QList<QStringList> > existing;
+    QStringList rs;
+
+    for (int i=0; i<list.count() && rs.count() < count; ++i)
+    {
+        const AccessPath &path = list.at(i).path;
+        bool covered = (path.columns.first() == path.pk);
+
+        if (!existing.contains(path.table))
+            existing.insert(path.table, indexes(db, path.table));
+
+        QList<QStringList> &table_indexes = existing[path.table];
+
+        for (int j=0; j<table_indexes.count() && !covered; ++j)
+            covered = covers(table_indexes.at(j), path);
+
+        if (covered)
+            continue;
+
+        QStringList columns;
+
+        for (int j=0; j<path.columns.count(); ++j)
+            columns.append(driver->escapeIdentifier(path.columns.at(j), QSqlDriver::FieldName));
+
+        rs.append(QString("CREATE INDEX %1 ON %2 (%3);").arg(
+            driver->escapeIdentifier(path.table + QLatin1Char('_') + path.columns.join(QLatin1String("_")) + QLatin1String("_idx"), QSqlDriver::TableName),
+            driver->escapeIdentifier(path.table, QSqlDriver::TableName),
+            columns.join(QLatin1String(", "))));
+
+        // Shorter paths of the same table may be served by this index
+        table_indexes.append(path.columns);
+    }
+
+    return rs;
+}
+
+void QIndexAdvisor::printRecommendations(int count)
+{
+    QStringList statements = recommendations(count);
+
+    for (int i=0; i<statements.count(); ++i)
+        qDebug() << statements.at(i);
+}
@@ -0,0 +1,63 @@
+/*
+ * qindexadvisor.h
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef __QINDEXADVISOR_H__
+#define __QINDEXADVISOR_H__
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QSqlDatabase>
+
+/*
+ * Records the columns used by the filters, the sort orders and the joins of
+ * the executed queries, and recommends indexes for the most used ones that
+ * the database doesn't have. Disabled by default.
+ */
+class QIndexAdvisor
+{
+    friend class QQuerySetPrivate;
+
+    public:
+        struct AccessPath
+        {
+            QString table;
+            QString pk;
+            QStringList columns;    // Equality columns first, sorted, then one range or sort column
+            int equalities;
+        };
+
+    public:
+        static void setEnabled(bool enabled);
+        static bool isEnabled();
+        static void clear();
+
+        static QStringList recommendations(int count = 10);   /*!< @brief CREATE INDEX statements for the heaviest unindexed access paths */
+        static void printRecommendations(int count = 10);
+
+    private:
+        static void record(const QList<AccessPath> &paths, qint64 usecs);
+        static QList<QStringList> indexes(const QSqlDatabase &db, const QString &table);
+        static bool covers(const QStringList &index, const AccessPath &path);
+};
+
+#endif
@@ -30,19 +30,19 @@ class QIntFieldPrivate : public QFieldPrivate
         ~QIntFieldPrivate();
 
         void setValue(int value);
+        int value() const;
 
         void fromData(const QVariant &data);
         QVariant data() const;
+        bool integerValue(qlonglong &value) const;
+        QString sqlType() const;
         QString sqlDescription() const;
-
-    private:
-        int _value;
 };
 
 QIntFieldPrivate::QIntFieldPrivate(QModel *model, const QString &name)
- : QFieldPrivate(model, name), _value(0)
+ : QFieldPrivate(model, name)
 {
-
+    allocateValue<int>(0);
 }
 
 QIntFieldPrivate::~QIntFieldPrivate()
@@ -54,14 +54,24 @@ void QIntFieldPrivate::setValue(int value)
 {
     setNull(false); // The field is not null anymore
     setModified(true);
-    _value = value;
+    rowValue<int>() = value;
+}
+
+int QIntFieldPrivate::value() const
+{
+    ensureLoaded();
+
+    if (isNull())
+        return 0;
+
+    return rowValue<int>();
 }
 
 void QIntFieldPrivate::fromData(const QVariant &data)
 {
     setNull(data.isNull());
     setModified(false);
-    _value = data.toInt();
+    rowValue<int>() = data.toInt();
 }
 
 QVariant QIntFieldPrivate::data() const
@@ -69,12 +79,26 @@ QVariant QIntFieldPrivate::data() const
     if (isNull())
         return QVariant();
     else
-        return QVariant(_value);
+        return QVariant(rowValue<int>());
+}
+
+bool QIntFieldPrivate::integerValue(qlonglong &value) const
+{
+    if (isNull())
+        return false;
+
+    value = rowValue<int>();
+    return true;
+}
+
+QString QIntFieldPrivate::sqlType() const
+{
+    return QLatin1String("INTEGER");
 }
 
 QString QIntFieldPrivate::sqlDescription() const
 {
-    QString rs = QLatin1String("INTEGER");
+    QString rs = sqlType();
 
     rs += commonSqlDescription();
 
@@ -91,7 +115,7 @@ QIntField::QIntField()
 }
 
 QIntField::QIntField(QModel *model, const QString &name)
- : QField(new QIntFieldPrivate(model, name))
+ : QField(new (model) QIntFieldPrivate(model, name))
 {
 }
 
@@ -101,7 +125,17 @@ QIntField::~QIntField()
 
 QIntField::operator int() const
 {
-    return dptr()->data().toInt();
+    return dptr()->value();
+}
+
+int QIntField::value() const
+{
+    return dptr()->value();
+}
+
+void QIntField::setValue(int value)
+{
+    dptr()->setValue(value);
 }
 
 QIntField &QIntField::operator=(int value)
@@ -35,6 +35,8 @@ class QIntField : public QField
         ~QIntField();
 
         operator int() const;
+        int value() const;    /*!< @brief Value of the field, read without QVariant */
+        void setValue(int value);
         QIntField &operator=(int value);
 
         _Q_F_ASSIGN(QIntField)
@@ -45,4 +47,10 @@ class QIntField : public QField
 
 Q_DECLARE_TYPEINFO(QIntField, Q_MOVABLE_TYPE);
 
+template<>
+struct QFieldTraits<QIntField>
+{
+    typedef int ValueType;
+};
+
 #endif
@@ -23,29 +23,188 @@
 #include "qmodel.h"
 #include "qfield_p.h"
 #include "qtormdatabase.h"
+#include "qsqlwriter_p.h"
+#include "qtorminstrumentation.h"
 
 #include <QVector>
 #include <QList>
+#include <QHash>
+#include <QByteArray>
 #include <QVariant>
 #include <QtSql>
 #include <QtDebug>
+#include <QMutex>
+#include <QAtomicPointer>
+
+#include <typeinfo>
+
+/*
+ * Schemas of the fields of every model, registered by the first instance of
+ * the model to be initialized and keyed by its C++ type, so that a table
+ * renamed by setTableName() keeps its schema. Next instances share them
+ * instead of having their own copy.
+ */
+struct QModelSchema
+{
+    QVector<QFieldSchema *> fields;     // In creation order
+    int row_size;
+    int fields_size;                    // Private objects of the fields, in the row
+};
+
+typedef QHash<const char *, const QModelSchema *> QModelSchemas;
+
+/*
+ * Lookups only read the published table. A registration copies it under the
+ * mutex and publishes the copy, the old tables are never freed because a
+ * lookup may still be reading them, and there is one of them per model type.
+ */
+static QMutex schemas_mutex;
+static QBasicAtomicPointer<QModelSchemas> schemas = Q_BASIC_ATOMIC_INITIALIZER(0);     // Static, models may be globals
+
+// Name of the dynamic type, unique per type, NULL for a plain QModel
+static const char *schemaKey(const QModel *model)
+{
+    if (typeid(*model) == typeid(QModel))
+        return NULL;
+
+    return typeid(*model).name();
+}
+
+static inline qint64 instrumentationStart()
+{
+    return (QtOrmInstrumentation::isEnabled() ? QtOrmInstrumentation::timestamp() : 0);
+}
+
+// Prepare a statement built since start
+static void prepareStatement(QSqlQuery &query, const QSqlWriter &writer,
+                             QtOrmInstrumentation::StatementKind kind, const QString &table, qint64 start)
+{
+    if (!QtOrmInstrumentation::isEnabled())
+    {
+        query.prepare(writer.sql());
+        return;
+    }
+
+    QtOrmInstrumentation::record(QtOrmInstrumentation::Build, kind, table, writer.sql(), start);
+
+    start = QtOrmInstrumentation::timestamp();
+    query.prepare(writer.sql());
+
+    QtOrmInstrumentation::record(QtOrmInstrumentation::Prepare, kind, table, writer.sql(), start);
+}
+
+// Run a prepared statement, logged with its plan if it is slow
+static bool execStatement(QSqlQuery &query, const QSqlWriter &writer,
+                          QtOrmInstrumentation::StatementKind kind, const QString &table)
+{
+    return QtOrmDatabase::exec(QtOrmDatabase::threadDatabase(), query, writer.sql(), writer.values(), kind, table);
+}
 
 struct QModel::Private
 {
+    struct Index
+    {
+        QList<QField> fields;
+        bool unique;
+        QWhere where;
+    };
+
     Private()
-     : tableNumber(0)
+     : tableNumber(0),
+       schema(NULL),
+       schema_looked_up(false),
+       schema_index(0),
+       row(new QModelRow),
+       index_foreign_keys(true)
+    {
+    }
+
+    ~Private()
     {
+        if (!row->deref())
+            delete row;
     }
 
     QString db_table;
     int tableNumber;
 
+    QByteArray escaped_driver;          // QtOrmDatabase::driverType()
+    QString escaped_table;
+
     QVector<QField> fields;
     QField primaryKey;
 
+    const QModelSchema *schema;
+    bool schema_looked_up;
+    int schema_index;
+
+    QModelRow *row;
+
     QList<QVariantList> batch;
+
+    struct UpdateRow
+    {
+        QVariant pk;
+        QByteArray columns;     // One byte per field, 1 if the field is updated
+        QVariantList values;
+    };
+
+    QList<UpdateRow> update_batch;
+
+    QList<Index> indexes;
+    bool index_foreign_keys;
+
+    QList<Index> allIndexes() const;
+    QString indexName(const Index &index) const;
 };
 
+QList<QModel::Private::Index> QModel::Private::allIndexes() const
+{
+    QList<Index> rs = indexes;
+
+    if (!index_foreign_keys)
+        return rs;
+
+    // Foreign keys are used by joins and fillCache(), they need an index
+    for (int i=0; i<fields.count(); ++i)
+    {
+        const QField &field = fields.at(i);
+        bool indexed = field.primaryKey();
+
+        if (!field.d->isForeignKey())
+            continue;
+
+        for (int j=0; j<indexes.count() && !indexed; ++j)
+            indexed = (indexes.at(j).fields.first() == field && !indexes.at(j).where.isValid());
+
+        if (!indexed)
+        {
+            Index index;
+
+            index.fields.append(field);
+            index.unique = false;
+            rs.append(index);
+        }
+    }
+
+    return rs;
+}
+
+QString QModel::Private::indexName(const Index &index) const
+{
+    QString rs = db_table;
+
+    for (int i=0; i<index.fields.count(); ++i)
+        rs += QLatin1Char('_') + index.fields.at(i).name();
+
+    if (index.where.isValid())
+        rs += QLatin1String("_part");
+
+    rs += (index.unique ? QLatin1String("_key") : QLatin1String("_idx"));
+
+    return rs;
+}
+
 QModel::QModel(const QString &tableName)
 : d(new QModel::Private())
 {
@@ -60,33 +219,142 @@ QModel::~QModel()
 void QModel::setTableName(const QString &tableName)
 {
     d->db_table = tableName;
+    d->escaped_table = QString();
+}
+
+const QString &QModel::escapedTableName(QSqlDriver *driver) const
+{
+    const char *type = QtOrmDatabase::driverType(driver);
+
+    if (d->escaped_driver != type || d->escaped_table.isNull())
+    {
+        d->escaped_driver = type;
+        d->escaped_table = driver->escapeIdentifier(d->db_table, QSqlDriver::TableName);
+    }
+
+    return d->escaped_table;
 }
 
 void QModel::init()
 {
+    bool create_pk = true;
+
     // Explore the field and set/create the primary key
     for (int i=0; i<d->fields.size(); ++i)
     {
         if (d->fields.at(i).primaryKey())
         {
             d->primaryKey = d->fields.at(i);
+            create_pk = false;
             break;
         }
     }
 
-    if (!d->primaryKey.isValid())
+    if (create_pk)
     {
         // Create a primary key field
         d->primaryKey = intField("id");
         d->primaryKey.setAutoIncrement(true);
         d->primaryKey.setPrimaryKey(true);
+    }
 
+    registerSchema();
+
+    if (create_pk)
+    {
         // We want id to be the first field
         d->fields.prepend(d->primaryKey);
         d->fields.remove(d->fields.size()-1);
     }
 }
 
+void QModel::registerSchema()
+{
+    // Fields are still in creation order
+    const char *key = schemaKey(this);
+
+    if (d->schema || !key)
+        return;
+
+    QMutexLocker locker(&schemas_mutex);
+    const QModelSchemas *published = schemas;
+
+    // Another instance may have been initialized meanwhile, keep our schema
+    if (published && published->contains(key))
+        return;
+
+    QModelSchema *schema = new QModelSchema;
+
+    schema->fields.reserve(d->fields.count());
+    schema->row_size = d->row->size();
+    schema->fields_size = d->row->fieldsSize();
+
+    for (int i=0; i<d->fields.count(); ++i)
+    {
+        QFieldSchema *field_schema = d->fields.at(i).d->schema();
+
+        field_schema->shared = true;
+        schema->fields.append(field_schema);
+    }
+
+    QModelSchemas *copy = (published ? new QModelSchemas(*published) : new QModelSchemas);
+
+    copy->insert(key, schema);
+    schemas.fetchAndStoreOrdered(copy);
+    d->schema = schema;
+}
+
+QModelRow *QModel::row() const
+{
+    return d->row;
+}
+
+void QModel::lookupSchema()
+{
+    // First field, created by the constructor of the subclass
+    const char *key = schemaKey(this);
+    const QModelSchemas *published = schemas;
+
+    d->schema_looked_up = true;
+
+    if (key && published)
+        d->schema = published->value(key);
+
+    if (d->schema)
+    {
+        d->fields.reserve(d->schema->fields.count());
+        d->row->reserve(d->schema->row_size);
+        d->row->reserveFields(d->schema->fields_size);
+    }
+}
+
+void *QModel::allocateField(size_t size)
+{
+    if (!d->schema_looked_up)
+        lookupSchema();
+
+    return d->row->allocateField(size);
+}
+
+QFieldSchema *QModel::sharedFieldSchema(const QString &name)
+{
+    int index = d->schema_index++;
+
+    if (!d->schema_looked_up)
+        lookupSchema();
+
+    if (!d->schema || index >= d->schema->fields.count())
+        return NULL;
+
+    QFieldSchema *schema = d->schema->fields.at(index);
+
+    // Same type, but not the same fields
+    if (schema->name != name)
+        return NULL;
+
+    return schema;
+}
+
 void QModel::addField(const QField &field)
 {
     d->fields.append(field);
@@ -138,11 +406,25 @@ QDateTimeField QModel::dateTimeField(const QString& name)
     return rs;
 }
 
+QBlobField QModel::blobField(const QString &name)
+{
+    QBlobField rs(this, name);
+
+    addField(rs);
+
+    return rs;
+}
+
 void QModel::clearBatch()
 {
     d->batch.clear();
 }
 
+void QModel::clearUpdateBatch()
+{
+    d->update_batch.clear();
+}
+
 void QModel::addInBatch()
 {
     QVariantList row;
@@ -160,12 +442,17 @@ void QModel::saveBatch()
     if (d->batch.size() == 0)
         return;
 
+    qint64 start = instrumentationStart();
+    qint64 call_start = start;
     QSqlDriver *driver = QtOrmDatabase::threadDatabase().driver();
     QSqlQuery query(QtOrmDatabase::threadDatabase());
+    QSqlWriter writer(driver, 64 + d->batch.size() * (d->batch.at(0).size() * 3 + 4));
+
+    writer << "INSERT INTO ";
+    writer.appendTableName(this);
+    writer << " (";
 
-    // Build the fields list and placeholder lists, skip the primary key
-    QString field_list;
-    QString placeholders;
+    // Build the fields list, skip the primary key
     bool first = true;
 
     for (int i=0; i<d->fields.size(); ++i)
@@ -174,54 +461,277 @@ void QModel::saveBatch()
             continue;
 
         if (!first)
-        {
-            field_list += QLatin1String(", ");
-            placeholders += QLatin1String(", ");
-        }
+            writer << ", ";
 
-        field_list += driver->escapeIdentifier(d->fields.at(i).name(), QSqlDriver::FieldName);
-        placeholders += QLatin1String("?");
+        writer.appendName(d->fields.at(i));
         first = false;
     }
 
-    // Multiply placeholders (change "?, ?" to "(?, ?), (?, ?), etc")
-    placeholders = QString("(%1), ").arg(placeholders);
-    placeholders = placeholders.repeated(d->batch.size());
-    placeholders.resize(placeholders.size() - 2);   // Remove the last ", "
-
-    // INSERT query
-    QString sql = QString("INSERT INTO %1 (%2) VALUES %3;")
-        .arg(driver->escapeIdentifier(d->db_table, QSqlDriver::TableName))
-        .arg(field_list)
-        .arg(placeholders);
-
-    query.prepare(sql);
+    // One "(?, ?)" group of placeholders per row, with its values
+    writer << ") VALUES ";
 
-    // Bind the values
     for (int i=0; i<d->batch.size(); ++i)
     {
-        int field_index_in_batch = 0;
+        if (i != 0)
+            writer << ", ";
 
-        for (int j=0; j<d->fields.size(); ++j)
-            if (!(d->fields.at(j).primaryKey() && d->fields.at(j).isNull()))
-                query.addBindValue(d->batch.at(i).at(field_index_in_batch++));
+        writer << '(';
+        writer.appendValues(d->batch.at(i));
+        writer << ')';
     }
 
-    if (!query.exec())
+    writer << ';';
+
+    prepareStatement(query, writer, QtOrmInstrumentation::Insert, d->db_table, start);
+
+    // Bind the values
+    for (int i=0; i<writer.values().count(); ++i)
+        query.addBindValue(writer.values().at(i));
+
+    if (!execStatement(query, writer, QtOrmInstrumentation::Insert, d->db_table))
     {
         qDebug() << "Could not save object :" << query.lastError();
     }
 
     // Set the id
     pk().setRawData(query.lastInsertId());
+
+    if (QtOrmInstrumentation::isEnabled())
+        QtOrmInstrumentation::record(QtOrmInstrumentation::Call, QtOrmInstrumentation::Insert, d->db_table,
+                                     QLatin1String("QModel::saveBatch"), call_start, d->batch.size());
+}
+
+void QModel::addInUpdateBatch()
+{
+    if (pk().isNull())
+    {
+        qDebug() << "Cannot add an object without primary key in an update batch";
+        return;
+    }
+
+    Private::UpdateRow row;
+
+    row.pk = pk().data();
+    row.columns.fill(0, d->fields.size());
+
+    // Snapshot the fields modified since the previous row, they stay modified
+    // until updateBatch() commits them
+    for (int i=0; i<d->fields.size(); ++i)
+    {
+        QFieldPrivate *field = d->fields.at(i).d;
+
+        if (!field->isModified() || field->isBatched() || field->primaryKey())
+            continue;
+
+        row.columns[i] = 1;
+        row.values.append(d->fields.at(i).data());
+        field->setBatched(true);
+    }
+
+    if (row.values.count() != 0)
+        d->update_batch.append(row);
+}
+
+bool QModel::updateBatch(int chunkSize)
+{
+    if (d->update_batch.size() == 0)
+        return true;
+
+    qint64 call_start = instrumentationStart();
+    QSqlDatabase db = QtOrmDatabase::threadDatabase();
+    QSqlDriver *driver = db.driver();
+    QSqlQuery query(db);
+    bool postgresql = (QtOrmDatabase::dialect(db) == QtOrmDatabase::PostgreSQL);
+    int updated_rows = d->update_batch.size();
+
+    // Group the rows by set of updated columns, each group is updated by
+    // one statement per chunk
+    QList<QByteArray> signatures;
+    QHash<QByteArray, QList<int> > groups;
+
+    for (int i=0; i<d->update_batch.size(); ++i)
+    {
+        const QByteArray &columns = d->update_batch.at(i).columns;
+
+        if (!groups.contains(columns))
+            signatures.append(columns);
+
+        groups[columns].append(i);
+    }
+
+    // Run everything in one transaction if we are not already in one
+    bool transaction = db.transaction();
+    bool ok = true;
+
+    for (int g=0; ok && g<signatures.size(); ++g)
+    {
+        const QByteArray &columns = signatures.at(g);
+        const QList<int> &rows = groups[columns];
+        QList<QField> fields;
+
+        for (int i=0; i<columns.size(); ++i)
+            if (columns.at(i))
+                fields.append(d->fields.at(i));
+
+        // Number of rows per statement, bounded by the number of bind values
+        // the database accepts
+        int values_per_row = (postgresql ? fields.size() + 1 : fields.size() * 2 + 1);
+        int rows_per_chunk = qMax(1, QtOrmDatabase::maxBindValues(db) / values_per_row);
+
+        if (chunkSize > 0)
+            rows_per_chunk = qMin(rows_per_chunk, chunkSize);
+
+        for (int start=0; ok && start<rows.size(); start += rows_per_chunk)
+        {
+            int count = qMin(rows_per_chunk, rows.size() - start);
+            qint64 build_start = instrumentationStart();
+            QSqlWriter writer(driver, 128 + count * values_per_row * 16);
+
+            writer << "UPDATE ";
+            writer.appendTableName(this);
+            writer << " SET ";
+
+            if (postgresql)
+            {
+                // UPDATE ... FROM a VALUES list. The VALUES list is appended to an
+                // empty SELECT on the table so that its columns get the types of
+                // the table columns instead of the text type of bare placeholders.
+                for (int i=0; i<fields.size(); ++i)
+                {
+                    if (i != 0)
+                        writer << ", ";
+
+                    writer.appendName(fields.at(i));
+                    writer << " = qtorm_v.";
+                    writer.appendName(fields.at(i));
+                }
+
+                writer << " FROM (SELECT ";
+                writer.appendName(pk());
+
+                for (int i=0; i<fields.size(); ++i)
+                {
+                    writer << ", ";
+                    writer.appendName(fields.at(i));
+                }
+
+                writer << " FROM ";
+                writer.appendTableName(this);
+                writer << " WHERE 1 = 0 UNION ALL VALUES ";
+
+                for (int r=start; r<start+count; ++r)
+                {
+                    const Private::UpdateRow &row = d->update_batch.at(rows.at(r));
+
+                    writer << (r == start ? "(" : ", (");
+                    writer.appendValue(row.pk);
+                    writer << ", ";
+                    writer.appendValues(row.values);
+                    writer << ')';
+                }
+
+                writer << ") AS qtorm_v WHERE ";
+                writer.appendTableName(this);
+                writer << '.';
+                writer.appendName(pk());
+                writer << " = qtorm_v.";
+                writer.appendName(pk());
+                writer << ';';
+            }
+            else
+            {
+                // One CASE expression per column, portable to every database
+                for (int i=0; i<fields.size(); ++i)
+                {
+                    if (i != 0)
+                        writer << ", ";
+
+                    writer.appendName(fields.at(i));
+                    writer << " = CASE ";
+                    writer.appendName(pk());
+
+                    for (int r=start; r<start+count; ++r)
+                    {
+                        const Private::UpdateRow &row = d->update_batch.at(rows.at(r));
+
+                        writer << " WHEN ";
+                        writer.appendValue(row.pk);
+                        writer << " THEN ";
+                        writer.appendValue(row.values.at(i));
+                    }
+
+                    writer << " END";
+                }
+
+                writer << " WHERE ";
+                writer.appendName(pk());
+                writer << " IN (";
+
+                for (int r=start; r<start+count; ++r)
+                {
+                    if (r != start)
+                        writer << ", ";
+
+                    writer.appendValue(d->update_batch.at(rows.at(r)).pk);
+                }
+
+                writer << ");";
+            }
+
+            prepareStatement(query, writer, QtOrmInstrumentation::Update, d->db_table, build_start);
+
+            for (int i=0; i<writer.values().count(); ++i)
+                query.addBindValue(writer.values().at(i));
+
+            if (!execStatement(query, writer, QtOrmInstrumentation::Update, d->db_table))
+            {
+                qDebug() << "Could not update objects :" << query.lastError();
+                ok = false;
+            }
+        }
+    }
+
+    if (transaction)
+    {
+        if (ok)
+            ok = db.commit();
+        else
+            db.rollback();
+    }
+
+    // Kept on failure, so that the caller can retry, and the model stays
+    // modified so that save() still writes its values
+    for (int i=0; i<d->fields.size(); ++i)
+    {
+        QFieldPrivate *field = d->fields.at(i).d;
+
+        if (!field->isBatched())
+            continue;
+
+        if (ok)
+            field->setModified(false);
+        else
+            field->setBatched(false);
+    }
+
+    if (ok)
+        d->update_batch.clear();
+
+    if (QtOrmInstrumentation::isEnabled())
+        QtOrmInstrumentation::record(QtOrmInstrumentation::Call, QtOrmInstrumentation::Update, d->db_table,
+                                     QLatin1String("QModel::updateBatch"), call_start, updated_rows);
+
+    return ok;
 }
 
 void QModel::save(bool forceInsert)
 {
+    qint64 call_start = instrumentationStart();
     QSqlDriver *driver = QtOrmDatabase::threadDatabase().driver();
     QSqlQuery query(QtOrmDatabase::threadDatabase());
+    bool insert = (forceInsert || pk().isNull());
 
-    if (forceInsert || pk().isNull())
+    if (insert)
     {
         // Create a new entry in the database
         clearBatch();
@@ -231,9 +741,14 @@ void QModel::save(bool forceInsert)
     else
     {
         // Only update an existing field
-        QString values;
+        qint64 start = instrumentationStart();
+        QSqlWriter writer(driver);
         bool first = true;
 
+        writer << "UPDATE ";
+        writer.appendTableName(this);
+        writer << " SET ";
+
         for (int i=0; i<d->fields.size(); ++i)
         {
             // Ne pas mettre à jour les champs non modifiés
@@ -241,34 +756,35 @@ void QModel::save(bool forceInsert)
                 continue;
 
             if (!first)
-                values += QLatin1String(", ");
+                writer << ", ";
 
-            values += driver->escapeIdentifier(d->fields.at(i).name(), QSqlDriver::FieldName);
-            values += QLatin1String("=?");
+            writer.appendName(d->fields.at(i));
+            writer << '=';
+            writer.appendValue(d->fields.at(i).data());
             first = false;
         }
 
         // UPDATE query
-        QString sql = QString("UPDATE %1 SET %2 WHERE %3=?;")
-            .arg(driver->escapeIdentifier(d->db_table, QSqlDriver::TableName))
-            .arg(values)
-            .arg(driver->escapeIdentifier(pk().name(), QSqlDriver::FieldName));
+        writer << " WHERE ";
+        writer.appendName(pk());
+        writer << '=';
+        writer.appendValue(pk().data());
+        writer << ';';
 
-        query.prepare(sql);
-
-        for (int i=0; i<d->fields.size(); ++i)
-        {
-            if (d->fields.at(i).isModified())
-                query.addBindValue(d->fields.at(i).data());
-        }
+        prepareStatement(query, writer, QtOrmInstrumentation::Update, d->db_table, start);
 
-        query.addBindValue(pk().data());
+        for (int i=0; i<writer.values().count(); ++i)
+            query.addBindValue(writer.values().at(i));
 
-        if (!query.exec())
+        if (!execStatement(query, writer, QtOrmInstrumentation::Update, d->db_table))
         {
             qDebug() << "Could not update object :" << query.lastError();
         }
     }
+
+    if (QtOrmInstrumentation::isEnabled())
+        QtOrmInstrumentation::record(QtOrmInstrumentation::Call, insert ? QtOrmInstrumentation::Insert : QtOrmInstrumentation::Update,
+                                     d->db_table, QLatin1String("QModel::save"), call_start);
 }
 
 void QModel::remove()
@@ -277,43 +793,207 @@ void QModel::remove()
     QSqlQuery query(QtOrmDatabase::threadDatabase());
 
     // DELETE the current object, and set pk() to NULL
-    QString sql = QString("DELETE FROM %1 WHERE %2=?;")
-        .arg(driver->escapeIdentifier(d->db_table, QSqlDriver::TableName))
-        .arg(driver->escapeIdentifier(pk().name(), QSqlDriver::FieldName));
-
-    query.prepare(sql);
-    query.addBindValue(pk().data());
-
-    if (!query.exec())
+    qint64 start = instrumentationStart();
+    qint64 call_start = start;
+    QSqlWriter writer(driver);
+
+    writer << "DELETE FROM ";
+    writer.appendTableName(this);
+    writer << " WHERE ";
+    writer.appendName(pk());
+    writer << '=';
+    writer.appendValue(pk().data());
+    writer << ';';
+
+    prepareStatement(query, writer, QtOrmInstrumentation::Delete, d->db_table, start);
+    query.addBindValue(writer.values().at(0));
+
+    if (!execStatement(query, writer, QtOrmInstrumentation::Delete, d->db_table))
     {
         qDebug() << "Could not delete object :" << query.lastError();
     }
 
     pk().setNull(true);
+
+    if (QtOrmInstrumentation::isEnabled())
+        QtOrmInstrumentation::record(QtOrmInstrumentation::Call, QtOrmInstrumentation::Delete, d->db_table,
+                                     QLatin1String("QModel::remove"), call_start);
 }
 
 QString QModel::createTableSql() const
 {
     QSqlDriver *driver = QSqlDatabase::database().driver();
 
-    // Build the fields list
-    QString field_list;
+    QSqlWriter writer(driver, 32 + d->fields.size() * 48);
+
+    // CREATE TABLE statement
+    writer << "CREATE TABLE ";
+    writer.appendTableName(this);
+    writer << " (\n";
 
+    // Build the fields list
     for (int i=0; i<d->fields.size(); ++i)
     {
-        field_list += QLatin1String("    ");
-        field_list += driver->escapeIdentifier(d->fields.at(i).name(), QSqlDriver::FieldName);
-        field_list += QChar(' ');
-        field_list += d->fields.at(i).sqlDescription();
+        writer << "    ";
+        writer.appendName(d->fields.at(i));
+        writer << ' ' << d->fields.at(i).sqlDescription();
 
         if (i != d->fields.size() - 1)
-            field_list += QLatin1String(",\n");
+            writer << ",\n";
     }
 
-    // CREATE TABLE statement
-    return QString("CREATE TABLE %1 (\n%2\n);")
-        .arg(driver->escapeIdentifier(d->db_table, QSqlDriver::TableName))
-        .arg(field_list);
+    writer << "\n);";
+
+    return writer.sql();
+}
+
+QStringList QModel::createIndexesSql() const
+{
+    QSqlDatabase db = QtOrmDatabase::threadDatabase();
+    QSqlDriver *driver = db.driver();
+    QtOrmDatabase::Dialect dialect = QtOrmDatabase::dialect(db);
+    QList<Private::Index> indexes = d->allIndexes();
+    QStringList rs;
+
+    for (int i=0; i<indexes.count(); ++i)
+    {
+        const Private::Index &index = indexes.at(i);
+
+        if (index.where.isValid() && dialect == QtOrmDatabase::MySQL)
+        {
+            qDebug() << "MySQL has no partial indexes, skipping" << d->indexName(index);
+            continue;
+        }
+
+        // DDL has no bind values, the values of the filter are inlined
+        QSqlWriter writer(driver, 64);
+
+        writer.setAliasPolicy(QSqlWriter::NoAliases);
+        writer.setDialect(dialect);
+        writer.setPlaceholderStyle(QSqlWriter::InlineValues);
+
+        writer << (index.unique ? "CREATE UNIQUE INDEX " : "CREATE INDEX ");
+        writer << driver->escapeIdentifier(d->indexName(index), QSqlDriver::TableName);
+        writer << " ON ";
+        writer.appendTableName(this);
+        writer << " (";
+
+        for (int j=0; j<index.fields.count(); ++j)
+        {
+            if (j != 0)
+                writer << ", ";
+
+            writer.appendName(index.fields.at(j));
+        }
+
+        writer << ')';
+
+        if (index.where.isValid())
+        {
+            writer << " WHERE ";
+            index.where.writeSql(writer);
+        }
+
+        writer << ';';
+
+        rs.append(writer.sql());
+    }
+
+    return rs;
+}
+
+bool QModel::createTable(bool deferIndexes)
+{
+    QSqlQuery query(QtOrmDatabase::threadDatabase());
+
+    if (!query.exec(createTableSql()))
+    {
+        qDebug() << "Could not create table" << d->db_table << ":" << query.lastError();
+        return false;
+    }
+
+    if (deferIndexes)
+        return true;
+
+    return createIndexes();
+}
+
+bool QModel::createIndexes()
+{
+    QSqlQuery query(QtOrmDatabase::threadDatabase());
+    QStringList statements = createIndexesSql();
+
+    // One pass over the table per index, after the rows are loaded
+    for (int i=0; i<statements.count(); ++i)
+    {
+        if (!query.exec(statements.at(i)))
+        {
+            qDebug() << "Could not create index :" << query.lastError();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool QModel::dropIndexes()
+{
+    QSqlDatabase db = QtOrmDatabase::threadDatabase();
+    QSqlDriver *driver = db.driver();
+    QSqlQuery query(db);
+    QList<Private::Index> indexes = d->allIndexes();
+    bool ok = true;
+
+    // Before a bulk load, to build the indexes again in one pass
+    for (int i=0; i<indexes.count(); ++i)
+    {
+        QSqlWriter writer(driver, 64);
+        QString name = driver->escapeIdentifier(d->indexName(indexes.at(i)), QSqlDriver::TableName);
+
+        if (QtOrmDatabase::dialect(db) == QtOrmDatabase::MySQL)
+        {
+            writer << "DROP INDEX " << name << " ON ";
+            writer.appendTableName(this);
+        }
+        else
+        {
+            writer << "DROP INDEX IF EXISTS " << name;
+        }
+
+        writer << ';';
+
+        if (!query.exec(writer.sql()))
+        {
+            qDebug() << "Could not drop index :" << query.lastError();
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+void QModel::addIndex(const QField &field, bool unique)
+{
+    addIndex(QList<QField>() << field, unique);
+}
+
+void QModel::addIndex(const QList<QField> &fields, bool unique, const QWhere &where)
+{
+    if (fields.count() == 0)
+        return;
+
+    Private::Index index;
+
+    index.fields = fields;
+    index.unique = unique;
+    index.where = where;
+
+    d->indexes.append(index);
+}
+
+void QModel::setIndexForeignKeys(bool index)
+{
+    d->index_foreign_keys = index;
 }
 
 void QModel::getForeignKeys(QVector<QForeignKeyPrivate *> &foreignKeys) const
@@ -25,20 +25,29 @@
 
 #include <QSqlDatabase>
 #include <QString>
+#include <QStringList>
 
 #include "qstringfield.h"
 #include "qintfield.h"
 #include "qforeignkey.h"
 #include "qdoublefield.h"
 #include "qdatetimefield.h"
+#include "qblobfield.h"
 
 class QQuerySetPrivate;
 class QForeignKeyPrivate;
+class QBatchRemove;
+class QSqlWriter;
+struct QFieldSchema;
+class QModelRow;
 
 class QModel
 {
     friend class QQuerySetPrivate;
     friend class QField;
+    friend class QFieldPrivate;
+    friend class QBatchRemove;
+    friend class QSqlWriter;
 
     private:
         Q_DISABLE_COPY(QModel)
@@ -53,20 +62,33 @@ class QModel
         void clearBatch();
         void addInBatch();
         void saveBatch();
+        void addInUpdateBatch();
+        void clearUpdateBatch();
+        bool updateBatch(int chunkSize = 0);
 
         void setTableName(const QString &tableName);
         void save(bool forceInsert=false);
         void remove();
         void resetModified();
         QString createTableSql() const;
+        QStringList createIndexesSql() const;       /*!< @brief CREATE INDEX statements of the declared indexes and of the foreign keys */
+        bool createTable(bool deferIndexes = false); /*!< @brief Create the table, and its indexes unless createIndexes() is called after a bulk load */
+        bool createIndexes();
+        bool dropIndexes();
 
     protected:
         void init();
 
+        // Indexes, partial ones can filter on the fields of this model
+        void addIndex(const QField &field, bool unique = false);
+        void addIndex(const QList<QField> &fields, bool unique = false, const QWhere &where = QWhere());
+        void setIndexForeignKeys(bool index);   /*!< @brief Index the foreign keys not starting an index, true by default */
+
         QStringField stringField(const QString &name);
         QIntField intField(const QString &name);
         QDoubleField doubleField(const QString &name);
         QDateTimeField dateTimeField(const QString &name);
+        QBlobField blobField(const QString &name);
         template<typename T>
         QForeignKey<T> foreignKey(const QString &name);
 
@@ -74,6 +96,12 @@ class QModel
         void getForeignKeys(QVector<QForeignKeyPrivate *> &foreignKeys) const;
         void setTableNumber(int tableNumber);
         int tableNumber() const;
+        const QString &escapedTableName(QSqlDriver *driver) const;
+        void registerSchema();
+        void lookupSchema();
+        void *allocateField(size_t size);
+        QFieldSchema *sharedFieldSchema(const QString &name);
+        QModelRow *row() const;
 
         int fieldsCount() const;
         const QField &field(int i) const;
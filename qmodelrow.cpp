@@ -0,0 +1,146 @@
+/*
+ * qmodelrow.cpp
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "qmodelrow_p.h"
+
+#include <stdlib.h>
+
+// Every slot is aligned for the largest types stored in it
+#define SLOT_ALIGNMENT 8
+
+// Field objects, a block is at least large enough for the fields of a small model
+#define FIELD_ALIGNMENT 16
+#define FIELD_BLOCK_HEADER ((sizeof(FieldBlock) + FIELD_ALIGNMENT - 1) & ~(FIELD_ALIGNMENT - 1))
+#define MIN_FIELD_BLOCK 512
+
+QModelRow::QModelRow()
+: _data(NULL),
+  _size(0),
+  _capacity(0),
+  _refcount(1),
+  _field_blocks(NULL),
+  _fields_size(0)
+{
+}
+
+QModelRow::~QModelRow()
+{
+    for (int i=0; i<_slots.count(); ++i)
+        _slots.at(i).destroy(_data + _slots.at(i).offset);
+
+    free(_data);
+
+    // The fields are already destroyed, they hold a reference on the row
+    while (_field_blocks)
+    {
+        FieldBlock *next = _field_blocks->next;
+
+        free(_field_blocks);
+        _field_blocks = next;
+    }
+}
+
+void QModelRow::ref()
+{
+    _refcount++;
+}
+
+bool QModelRow::deref()
+{
+    _refcount--;
+
+    return (_refcount != 0);
+}
+
+void QModelRow::reserve(int size)
+{
+    if (size <= _capacity)
+        return;
+
+    char *data = (char *)malloc(size);
+
+    // The old buffer is still owned by the row, but the slots cannot fit
+    if (!data)
+        qFatal("QModelRow: cannot allocate %d bytes", size);
+
+    for (int i=0; i<_slots.count(); ++i)
+        _slots.at(i).move(_data + _slots.at(i).offset, data + _slots.at(i).offset);
+
+    free(_data);
+
+    _data = data;
+    _capacity = size;
+}
+
+int QModelRow::size() const
+{
+    return _size;
+}
+
+int QModelRow::grow(int size)
+{
+    int offset = (_size + SLOT_ALIGNMENT - 1) & ~(SLOT_ALIGNMENT - 1);
+
+    if (offset + size > _capacity)
+        reserve(qMax(offset + size, _capacity * 2));
+
+    _size = offset + size;
+
+    return offset;
+}
+
+void QModelRow::reserveFields(int size)
+{
+    if (_field_blocks && _field_blocks->capacity - _field_blocks->used >= size)
+        return;
+
+    FieldBlock *block = (FieldBlock *)malloc(FIELD_BLOCK_HEADER + size);
+
+    if (!block)
+        qFatal("QModelRow: cannot allocate %d bytes", size);
+
+    block->next = _field_blocks;
+    block->capacity = size;
+    block->used = 0;
+    _field_blocks = block;
+}
+
+int QModelRow::fieldsSize() const
+{
+    return _fields_size;
+}
+
+void *QModelRow::allocateField(size_t size)
+{
+    int aligned = (size + FIELD_ALIGNMENT - 1) & ~(FIELD_ALIGNMENT - 1);
+
+    // Only the newest block is filled, the end of the others is lost
+    if (!_field_blocks || _field_blocks->capacity - _field_blocks->used < aligned)
+        reserveFields(qMax(aligned, MIN_FIELD_BLOCK));
+
+    char *rs = (char *)_field_blocks + FIELD_BLOCK_HEADER + _field_blocks->used;
+
+    _field_blocks->used += aligned;
+    _fields_size += aligned;
+
+    return rs;
+}
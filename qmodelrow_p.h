@@ -0,0 +1,151 @@
+/*
+ * qmodelrow_p.h
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef __QMODELROW_P_H__
+#define __QMODELROW_P_H__
+
+#include <new>
+
+#include <QVector>
+
+/*
+ * Values of all the fields of a model, in one buffer laid out in the order the
+ * fields are created. Every field has a slot made of its flags and its value.
+ *
+ * A grown buffer is a new one, the slots are copied into it and destroyed in
+ * the old one, so the values need not be movable with memcpy(). The next
+ * instances of a model reserve the size recorded in its schema, and never grow.
+ *
+ * The row also holds the private objects of the fields of its model, in blocks
+ * that never move. The schema of the model gives the size of both, so that the
+ * next instances allocate them once.
+ */
+class QModelRow
+{
+    public:
+        enum Flag
+        {
+            Null = 1,
+            Modified = 2,
+            Unloaded = 4,       /*!< @brief Value not fetched from the database yet */
+            Unread = 8,         /*!< @brief First read of the value to be reported to the loader */
+            Batched = 16        /*!< @brief Modified value already in the update batch of the model */
+        };
+
+        template<typename T>
+        struct Slot
+        {
+            unsigned char flags;
+            T value;
+        };
+
+    public:
+        QModelRow();
+        ~QModelRow();
+
+        void ref();
+        bool deref();
+
+        void reserve(int size);
+        int size() const;
+
+        void reserveFields(int size);
+        int fieldsSize() const;
+        void *allocateField(size_t size);
+
+        template<typename T>
+        int allocate(const T &value);
+
+        inline unsigned char &flags(int offset) const
+        {
+            return *(unsigned char *)(_data + offset);
+        }
+
+        template<typename T>
+        inline T &value(int offset) const
+        {
+            return ((Slot<T> *)(_data + offset))->value;
+        }
+
+    private:
+        int grow(int size);
+
+        template<typename T>
+        static void destroy(char *slot)
+        {
+            ((Slot<T> *)slot)->~Slot<T>();
+        }
+
+        template<typename T>
+        static void move(char *from, char *to)
+        {
+            new (to) Slot<T>(*(Slot<T> *)from);
+            ((Slot<T> *)from)->~Slot<T>();
+        }
+
+    private:
+        char *_data;
+        int _size, _capacity;
+        unsigned int _refcount;
+
+        typedef void (*Destructor)(char *);
+        typedef void (*Mover)(char *, char *);
+
+        struct SlotType
+        {
+            int offset;
+            Destructor destroy;
+            Mover move;
+        };
+
+        QVector<SlotType> _slots;
+
+        struct FieldBlock
+        {
+            FieldBlock *next;
+            int capacity, used;
+        };
+
+        FieldBlock *_field_blocks;      // Newest first
+        int _fields_size;
+};
+
+template<typename T>
+int QModelRow::allocate(const T &value)
+{
+    int offset = grow(sizeof(Slot<T>));
+    Slot<T> *slot = new (_data + offset) Slot<T>;
+
+    SlotType type;
+
+    slot->flags = Null;
+    slot->value = value;
+
+    type.offset = offset;
+    type.destroy = &QModelRow::destroy<T>;
+    type.move = &QModelRow::move<T>;
+    _slots.append(type);
+
+    return offset;
+}
+
+#endif
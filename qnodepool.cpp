@@ -0,0 +1,218 @@
+/*
+ * qnodepool.cpp
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "qnodepool_p.h"
+
+#include <QMutex>
+#include <QThreadStorage>
+
+#include <new>
+
+// Nodes are rounded up to a multiple of the granularity, bigger nodes go to operator new
+#define NODE_GRANULARITY 16
+#define NODE_CLASSES 8
+#define SLAB_SIZE 4096
+
+// A thread keeps at most this many free nodes of a class, twice a slab
+#define MAX_FREE_NODES(size_class) (2 * SLAB_SIZE / (((size_class) + 1) * NODE_GRANULARITY))
+
+// Fits in the smallest node
+struct FreeNode
+{
+    FreeNode *next;
+    FreeNode *next_batch;   // In the depot, next list of free nodes
+};
+
+enum ThreadState
+{
+    ThreadUnwatched,
+    ThreadWatched,          // Its free nodes go to the depot when it exits
+    ThreadExited            // Its exit hook ran, its free nodes go straight to the depot
+};
+
+static __thread FreeNode *free_nodes[NODE_CLASSES];
+static __thread int free_counts[NODE_CLASSES];
+static __thread int thread_state;
+
+/*
+ * Free nodes given back by the threads that exit or that free more nodes
+ * than they allocate, taken by the threads that run out of nodes.
+ */
+static QMutex depot_mutex;
+static FreeNode *depot[NODE_CLASSES];
+
+static void giveBack(int size_class, FreeNode *list)
+{
+    QMutexLocker locker(&depot_mutex);
+
+    list->next_batch = depot[size_class];
+    depot[size_class] = list;
+}
+
+static FreeNode *takeBack(int size_class)
+{
+    QMutexLocker locker(&depot_mutex);
+    FreeNode *list = depot[size_class];
+
+    if (list)
+        depot[size_class] = list->next_batch;
+
+    return list;
+}
+
+struct ThreadExitHook
+{
+    ~ThreadExitHook()
+    {
+        for (int i=0; i<NODE_CLASSES; ++i)
+        {
+            if (free_nodes[i])
+                giveBack(i, free_nodes[i]);
+
+            free_nodes[i] = NULL;
+            free_counts[i] = 0;
+        }
+
+        thread_state = ThreadExited;
+    }
+};
+
+static QThreadStorage<ThreadExitHook *> exit_hooks;
+
+static inline void watchThread()
+{
+    if (thread_state != ThreadUnwatched)
+        return;
+
+    thread_state = ThreadWatched;
+    exit_hooks.setLocalData(new ThreadExitHook);
+}
+
+static inline int sizeClass(size_t size)
+{
+    return (size + NODE_GRANULARITY - 1) / NODE_GRANULARITY - 1;
+}
+
+static int countNodes(const FreeNode *list)
+{
+    int rs = 0;
+
+    for (; list; list = list->next)
+        rs++;
+
+    return rs;
+}
+
+static FreeNode *allocateSlab(int size_class)
+{
+    size_t node_size = (size_class + 1) * NODE_GRANULARITY;
+    size_t count = SLAB_SIZE / node_size;
+    char *slab = static_cast<char *>(::operator new(count * node_size));
+    FreeNode *first = reinterpret_cast<FreeNode *>(slab);
+
+    // Chain the nodes of the slab
+    for (size_t i=0; i<count - 1; ++i)
+    {
+        reinterpret_cast<FreeNode *>(slab + i * node_size)->next =
+            reinterpret_cast<FreeNode *>(slab + (i + 1) * node_size);
+    }
+
+    reinterpret_cast<FreeNode *>(slab + (count - 1) * node_size)->next = NULL;
+
+    return first;
+}
+
+void *QNodePool::allocate(size_t size)
+{
+    int size_class = sizeClass(size);
+
+    if (size_class >= NODE_CLASSES)
+        return ::operator new(size);
+
+    FreeNode *node = free_nodes[size_class];
+
+    if (!node)
+    {
+        watchThread();
+
+        // Reuse the nodes given back by other threads before a new slab
+        node = takeBack(size_class);
+
+        if (!node)
+            node = allocateSlab(size_class);
+
+        free_counts[size_class] = countNodes(node);
+    }
+
+    free_nodes[size_class] = node->next;
+    free_counts[size_class]--;
+
+    if (thread_state == ThreadExited && free_nodes[size_class])
+    {
+        giveBack(size_class, free_nodes[size_class]);
+        free_nodes[size_class] = NULL;
+        free_counts[size_class] = 0;
+    }
+
+    return node;
+}
+
+void QNodePool::release(void *ptr, size_t size)
+{
+    if (!ptr)
+        return;
+
+    int size_class = sizeClass(size);
+
+    if (size_class >= NODE_CLASSES)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+
+    FreeNode *node = static_cast<FreeNode *>(ptr);
+
+    watchThread();
+
+    node->next = free_nodes[size_class];
+    free_nodes[size_class] = node;
+
+    if (thread_state == ThreadExited)
+    {
+        giveBack(size_class, node);
+        free_nodes[size_class] = NULL;
+        free_counts[size_class] = 0;
+    }
+    else if (++free_counts[size_class] >= MAX_FREE_NODES(size_class))
+    {
+        // Nodes allocated by another thread, keep half of them and give the rest back
+        int kept = free_counts[size_class] / 2;
+        FreeNode *last = free_nodes[size_class];
+
+        for (int i=1; i<kept; ++i)
+            last = last->next;
+
+        giveBack(size_class, last->next);
+        last->next = NULL;
+        free_counts[size_class] = kept;
+    }
+}
@@ -0,0 +1,48 @@
+/*
+ * qnodepool_p.h
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef __QNODEPOOL_P_H__
+#define __QNODEPOOL_P_H__
+
+#include <cstddef>
+
+/*
+ * Allocator for the small nodes of QWhere and QAssign trees. Every thread
+ * keeps free lists of nodes sorted by size class, carved in slabs, so that
+ * building and destroying a filter does not go through malloc for each of
+ * its predicates.
+ *
+ * A node freed by another thread than the one that allocated it is put in
+ * the free list of the freeing thread. A thread that keeps too many free
+ * nodes, or that exits, gives them back to a shared depot where the other
+ * threads take them before allocating new slabs. Slabs are never given back
+ * to the system, the memory used is bounded by the largest number of nodes
+ * alive at once.
+ */
+class QNodePool
+{
+    public:
+        static void *allocate(size_t size);
+        static void release(void *ptr, size_t size);
+};
+
+#endif
@@ -0,0 +1,236 @@
+/*
+ * qqueryplan.cpp
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "qqueryplan.h"
+#include "qtormdatabase.h"
+
+#include <QtSql>
+#include <QtDebug>
+#include <QHash>
+
+QQueryPlan::QQueryPlan()
+{
+}
+
+bool QQueryPlan::isValid() const
+{
+    return (_steps.count() != 0);
+}
+
+const QList<QQueryPlan::Step> &QQueryPlan::steps() const
+{
+    return _steps;
+}
+
+QString QQueryPlan::toString() const
+{
+    QHash<int, int> depths;
+    QString rs;
+
+    for (int i=0; i<_steps.count(); ++i)
+    {
+        const Step &step = _steps.at(i);
+        int depth = (step.parent == 0 ? 0 : depths.value(step.parent, -1) + 1);
+
+        depths.insert(step.id, depth);
+
+        rs += QString(depth * 2, QLatin1Char(' ')) + step.detail + QLatin1Char('\n');
+
+        for (int j=0; j<step.properties.count(); ++j)
+            rs += QString(depth * 2 + 4, QLatin1Char(' ')) + step.properties.at(j) + QLatin1Char('\n');
+    }
+
+    return rs;
+}
+
+void QQueryPlan::appendStep(int id, int parent, const QString &detail)
+{
+    Step step;
+
+    step.id = id;
+    step.parent = parent;
+    step.detail = detail;
+
+    _steps.append(step);
+}
+
+QString QQueryPlan::inlineValues(const QSqlDatabase &db, const QString &sql, const QVariantList &values)
+{
+    // EXPLAIN cannot always be prepared (PostgreSQL), the values are written
+    // as literals in place of the placeholders
+    QSqlDriver *driver = db.driver();
+    QString rs;
+    QChar quote;
+    int next_value = 0;
+
+    rs.reserve(sql.size() + values.count() * 8);
+
+    for (int i=0; i<sql.size(); ++i)
+    {
+        QChar c = sql.at(i);
+        int index = -1;
+
+        if (!quote.isNull())
+        {
+            if (c == quote)
+                quote = QChar();
+        }
+        else if (c == QLatin1Char('\'') || c == QLatin1Char('"') || c == QLatin1Char('`'))
+        {
+            quote = c;
+        }
+        else if (c == QLatin1Char('?'))
+        {
+            index = next_value++;
+        }
+        else if (c == QLatin1Char(':') && sql.mid(i + 1, 5) == QLatin1String("qtorm"))
+        {
+            int end = i + 6;
+
+            while (end < sql.size() && sql.at(end).isDigit())
+                ++end;
+
+            index = sql.mid(i + 6, end - i - 6).toInt();
+            i = end - 1;
+        }
+
+        if (index == -1)
+        {
+            rs += c;
+        }
+        else
+        {
+            QSqlField field(QString(), values.value(index).type());
+
+            field.setValue(values.value(index));
+            rs += driver->formatValue(field);
+        }
+    }
+
+    return rs;
+}
+
+QQueryPlan QQueryPlan::explain(const QSqlDatabase &db, const QString &sql, const QVariantList &values, bool analyze)
+{
+    QtOrmDatabase::Dialect dialect = QtOrmDatabase::dialect(db);
+    QString statement = inlineValues(db, sql, values);
+    QSqlQuery query(db);
+    QQueryPlan rs;
+
+    switch (dialect)
+    {
+        case QtOrmDatabase::SQLite:
+            statement.prepend(QLatin1String("EXPLAIN QUERY PLAN "));
+            break;
+        case QtOrmDatabase::PostgreSQL:
+            // ANALYZE runs the statement
+            statement.prepend(analyze ? QLatin1String("EXPLAIN (ANALYZE, BUFFERS) ") : QLatin1String("EXPLAIN "));
+            break;
+        default:
+            statement.prepend(QLatin1String("EXPLAIN "));
+            break;
+    }
+
+    if (!query.exec(statement))
+    {
+        qDebug() << "Cannot explain the query \"" << sql << "\" :" << query.lastError();
+        return rs;
+    }
+
+    if (dialect == QtOrmDatabase::SQLite)
+    {
+        // id, parent, notused, detail. Before SQLite 3.24 : selectid, order, from, detail
+        bool has_parent = (query.record().indexOf(QLatin1String("parent")) != -1);
+
+        while (query.next())
+        {
+            if (has_parent)
+                rs.appendStep(query.value(0).toInt(), query.value(1).toInt(), query.value(3).toString());
+            else
+                rs.appendStep(rs._steps.count() + 1, 0, query.value(3).toString());
+        }
+    }
+    else if (dialect == QtOrmDatabase::PostgreSQL)
+    {
+        // One line per row, the nodes start with "->" and are indented under
+        // their parent, the other lines describe the node above them
+        QList<QPair<int, int> > parents;    // Indentation and id
+
+        while (query.next())
+        {
+            QString line = query.value(0).toString();
+            int indent = 0;
+
+            while (indent < line.size() && line.at(indent) == QLatin1Char(' '))
+                ++indent;
+
+            QString text = line.mid(indent);
+            bool node = text.startsWith(QLatin1String("->"));
+
+            if (!node && rs._steps.count() != 0)
+            {
+                rs._steps.last().properties.append(text);
+                continue;
+            }
+
+            if (node)
+                text = text.mid(2).trimmed();
+
+            while (parents.count() != 0 && parents.last().first >= indent)
+                parents.removeLast();
+
+            int id = rs._steps.count() + 1;
+
+            rs.appendStep(id, parents.count() != 0 ? parents.last().second : 0, text);
+            parents.append(qMakePair(indent, id));
+        }
+    }
+    else
+    {
+        // One row per table (MySQL), every column is a property
+        QSqlRecord record = query.record();
+        int table = record.indexOf(QLatin1String("table"));
+
+        while (query.next())
+        {
+            rs.appendStep(rs._steps.count() + 1, 0, query.value(table == -1 ? 0 : table).toString());
+
+            for (int i=0; i<record.count(); ++i)
+            {
+                if (!query.value(i).isNull())
+                    rs._steps.last().properties.append(record.fieldName(i) + QLatin1String(": ") + query.value(i).toString());
+            }
+        }
+    }
+
+    return rs;
+}
+
+void QQueryPlan::logSlowQuery(const QSqlDatabase &db, const QString &sql, const QVariantList &values, qint64 usecs)
+{
+    // Not analyzed, the statement is not run again
+    QQueryPlan plan = explain(db, sql, values);
+
+    qDebug() << "Slow query (" << usecs / 1000 << "ms ) :" << sql;
+    qDebug() << "    Values :" << values;
+    qDebug() << "    Plan :" << plan.toString();
+}
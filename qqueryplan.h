@@ -0,0 +1,66 @@
+/*
+ * qqueryplan.h
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef __QQUERYPLAN_H__
+#define __QQUERYPLAN_H__
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QVariant>
+#include <QSqlDatabase>
+
+/*
+ * Plan of a statement, as returned by the EXPLAIN statement of the database.
+ * Every step has an id and the id of its parent step, 0 for the top-level
+ * steps.
+ */
+class QQueryPlan
+{
+    public:
+        struct Step
+        {
+            int id;
+            int parent;
+            QString detail;             /*!< @brief Operation, "SCAN TABLE book" or "Seq Scan on book" for instance */
+            QStringList properties;     /*!< @brief Other lines or columns describing the step (filters, costs, buffers, keys) */
+        };
+
+    public:
+        QQueryPlan();
+
+        bool isValid() const;
+        const QList<Step> &steps() const;
+        QString toString() const;       /*!< @brief Steps indented under their parent */
+
+        static QQueryPlan explain(const QSqlDatabase &db, const QString &sql, const QVariantList &values, bool analyze = false);
+        static void logSlowQuery(const QSqlDatabase &db, const QString &sql, const QVariantList &values, qint64 usecs);
+
+    private:
+        void appendStep(int id, int parent, const QString &detail);
+        static QString inlineValues(const QSqlDatabase &db, const QString &sql, const QVariantList &values);
+
+    private:
+        QList<Step> _steps;
+};
+
+#endif
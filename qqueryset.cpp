@@ -23,19 +23,33 @@
 #include "qqueryset.h"
 #include "qmodel.h"
 #include "qfield.h"
+#include "qfield_p.h"
 #include "qf.h"
 #include "qtormdatabase.h"
+#include "qindexadvisor.h"
+#include "qqueryplan.h"
+#include "qtorminstrumentation.h"
+#include "qsqlwriter_p.h"
+#include "qwhere_p.h"
 
 #include <QtSql>
 #include <QtDebug>
 #include <QVector>
+#include <QHash>
 #include <QSet>
 #include <QPair>
 #include <QString>
 
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+
 class QForeignKeyPrivate;
 
-class QQuerySetPrivate
+class QQuerySetPrivate : public QFieldLoader
 {
     public:
         QQuerySetPrivate(QModel *model, const QSqlDatabase &db);
@@ -47,18 +61,41 @@ class QQuerySetPrivate
         void addField(const QField &field);
         void addFields(QModel *model);
         void excludeField(const QField &field);
+        void deferField(const QField &field);
         void setLimit(int count);
         void setOffset(int val);
+        void setMaxJoinDepth(int depth);
+        void setRelationLoading(QQuerySet::RelationLoading mode);
+        void setTag(const QString &tag);
 
         bool next();
         bool update(int *affectedRows);
 
-        void build(bool for_remove);
-        void exec();
+        bool execValues(const QVector<QField> &fields);
+        bool nextValues();
+        QVariant value(int column) const;
+
+        bool loadField(QFieldPrivate *field);
+        void fieldRead(QFieldPrivate *field);
+
+        void build(bool for_remove, const QVector<QField> *values = NULL);
+        bool prepare();
+        bool exec();
+        QQueryPlan explain();
         QString sql() const;
         void reset();
 
+        void setIterating(bool iterating);
+        static void foreignKeyLoaded(const QFieldPrivate *field, const QModel *target);
+
     private:
+        enum Projection
+        {
+            FullProjection,
+            LearningProjection,         // Every field selected, the reads are recorded
+            NarrowedProjection          // The fields never read are loaded on demand
+        };
+
         struct Join
         {
             QModel *model;
@@ -66,47 +103,179 @@ class QQuerySetPrivate
             bool accepts_null;
         };
 
-        bool buildJoins(QList<QQuerySetPrivate::Join> &joins, bool useSelectedFields);
-        QList<Join> buildSelectedFields(bool for_remove);
-        QString buildSelect();
-        QString buildFrom(const QList<Join> &joins, bool for_remove);
-        QString buildWhere(bool for_remove);
-        QString buildOrderBy();
-        QString buildLimit();
+        void simplifyFilters();
+        bool buildJoins(QList<QQuerySetPrivate::Join> &joins, const QSet<QModel *> &models, bool related, int depth);
+        QList<Join> buildSelectedFields();
+        QList<Join> buildFilterJoins();
+        QSet<QModel *> filterModels() const;
+        bool filtersCrossTables() const;
+        void writeSelect(QSqlWriter &writer);
+        void writeFrom(QSqlWriter &writer, const QList<Join> &joins);
+        void writeWhere(QSqlWriter &writer);
+        void writeSingleTableWhere(QSqlWriter &writer);
+        void writeOrderBy(QSqlWriter &writer);
+        void writeLimit(QSqlWriter &writer);
+
+        void setupWriter(QSqlWriter &writer);
+        bool createTemporaryTables(const QList<QSqlWriter::TemporaryTable> &tables);
+        void dropTemporaryTables();
+
+        void buildAccessPaths(const QList<Join> &joins);
+
+        QString shape() const;
+        static void appendShapeField(QString &rs, char prefix, const QField &field);
+        void applyLearnedRelations();
+        void learnRelations();
+        void applyLearnedProjection();
+        void learnProjection();
+        bool narrowedOut(const QField &field) const;
+        void watchReads();
+
+        bool fillWindow();
+        bool loadWindow(int lazyField);
+        void releaseLazyFields();
 
     private:
+        QSqlDatabase _db;
         QSqlDriver *_driver;
+        QtOrmDatabase::Dialect _dialect;
         QModel *_model;
         int _limit, _offset;
-        bool _built, _executed;
+        int _max_join_depth;
+        bool _built, _prepared, _executed;
+        bool _never_matches;
+        int _sql_size;
+        QtOrmInstrumentation::StatementKind _kind;
 
         QVector<QField> _selected_fields;
+        QVector<QField> _columns;           // Selected by the statement built, with the learned relations
+        QVector<QField> _lazy_fields;
+        QVector<int> _lazy_pk_columns;
         QSet<QField> _excluded_fields;
-        QSet<QModel *> _selected_models;
+        QSet<QField> _deferred_fields;
         QVector<QField> _select_related;
+        QVector<QField> _related;           // Joined by the statement built, with the learned relations
         QVector<QWhere> _filter;
+        QWhere _where;
         QVector<QPair<QField, bool> > _order_by;
 
         QSqlQuery _query;
+        // Statement built by build(), prepared with its temporary tables by prepare()
+        QString _sql;
+        QVariantList _values;
+        QList<QSqlWriter::TemporaryTable> _pending_tables;
+        QStringList _temporary_tables;
+        QList<QIndexAdvisor::AccessPath> _access_paths;
+
+        // Rows read ahead when fields are loaded on demand, and the values of
+        // these fields for the whole window once one of them is accessed
+        QVector<QVariantList> _window;
+        QVector<QVariantList> _window_values;
+        int _window_pos;
+
+        // Foreign keys loaded one by one while the rows are iterated
+        bool _iterating, _watched, _learning;
+        QQuerySetPrivate *_outer_iteration, *_inner_iteration;
+        QHash<QString, int> _lazy_loads;
+        int _rows_iterated;
+        QString _tag;
+
+        // Relations joined because the previous iterations loaded them
+        QQuerySet::RelationLoading _relation_loading;
+        QString _shape;
+
+        // Fields selected because the previous iterations read them
+        Projection _projection;
+        QSet<QString> _projection_read;
+        QSet<QFieldPrivate *> _fields_read;
+};
+
+// Rows in a window, small enough to be bound in one IN list
+static const int WindowSize = 100;
+
+// Last watched query set the thread started iterating, the others being
+// linked by their _outer_iteration. Sets leave the list in any order.
+static __thread QQuerySetPrivate *iterating_queryset = NULL;
+
+// Iterations sampled, counting only the ones started when no other query set
+// of the thread iterates. The nested ones, the fill of a foreign key included,
+// are watched with their outermost iteration.
+static __thread int iterations_seen = 0;
+static __thread int iterations_nested = 0;
+static __thread bool iteration_watched = false;
+
+/*
+ * Foreign keys loaded one by one by the iterations of a query shape, every
+ * past iteration weighting less than the next one
+ */
+struct RelationStats
+{
+    RelationStats() : rows(0.0) {}
+
+    double rows;
+    QHash<QString, double> loads;       // By name of foreign key
+};
+
+static QMutex relation_stats_mutex;
+static QHash<QString, RelationStats> relation_stats;
+
+static const double RelationDecay = 0.8;        // Weight of the past at every iteration
+static const double MinRelationRows = 10.0;     // Rows needed before trusting the stats
+static const double RelationLoadRatio = 0.5;    // Share of the rows loading a foreign key to join it
+
+/*
+ * Fields read by the iterations of a query shape, by table and name
+ */
+struct ProjectionStats
+{
+    ProjectionStats() : executions(0) {}
+
+    int executions;
+    QSet<QString> read;
 };
 
+static QMutex projection_stats_mutex;
+static QHash<QString, ProjectionStats> projection_stats;
+
+static const int ProjectionLearningExecutions = 3;
+
 /*
  * Private
  */
 
 QQuerySetPrivate::QQuerySetPrivate(QModel *model, const QSqlDatabase &db)
-: _driver(db.driver()),
+: _db(db),
+  _driver(db.driver()),
+  _dialect(QtOrmDatabase::dialect(db)),
   _model(model),
   _limit(0),
   _offset(0),
+  _max_join_depth(4),
   _built(false),
+  _prepared(false),
   _executed(false),
-  _query(db)
+  _never_matches(false),
+  _sql_size(256),
+  _kind(QtOrmInstrumentation::Select),
+  _query(db),
+  _window_pos(-1),
+  _iterating(false),
+  _watched(false),
+  _learning(false),
+  _outer_iteration(NULL),
+  _inner_iteration(NULL),
+  _rows_iterated(0),
+  _relation_loading(QQuerySet::LearnRelations),
+  _projection(FullProjection)
 {
 }
 
 QQuerySetPrivate::~QQuerySetPrivate()
 {
+    setIterating(false);
+    _query.finish();
+    dropTemporaryTables();
+    releaseLazyFields();
 }
 
 void QQuerySetPrivate::addSelectRelated(const QField &field)
@@ -127,7 +296,6 @@ void QQuerySetPrivate::addOrderBy(const QField &field, bool asc)
 void QQuerySetPrivate::addField(const QField &field)
 {
     _selected_fields.append(field);
-    _selected_models.insert(field.model());
 }
 
 void QQuerySetPrivate::addFields(QModel *model)
@@ -145,6 +313,11 @@ void QQuerySetPrivate::excludeField(const QField &field)
     _excluded_fields.insert(field);
 }
 
+void QQuerySetPrivate::deferField(const QField &field)
+{
+    _deferred_fields.insert(field);
+}
+
 void QQuerySetPrivate::setLimit(int count)
 {
      _limit = count;
@@ -155,13 +328,37 @@ void QQuerySetPrivate::setOffset(int val)
     _offset = val;
 }
 
+void QQuerySetPrivate::setMaxJoinDepth(int depth)
+{
+    _max_join_depth = depth;
+}
+
+void QQuerySetPrivate::setRelationLoading(QQuerySet::RelationLoading mode)
+{
+    _relation_loading = mode;
+}
+
+void QQuerySetPrivate::setTag(const QString &tag)
+{
+    _tag = tag;
+}
+
 QString QQuerySetPrivate::sql() const
 {
-    return _query.lastQuery();
+    return _sql;
 }
 
 
-bool QQuerySetPrivate::buildJoins(QList<Join> &joins, bool useSelectedFields)
+void QQuerySetPrivate::simplifyFilters()
+{
+    // AND all the filters together and normalize the result
+    _where = QListWhere(_filter.toList(), QWhere::And).simplified();
+    _never_matches = _where.isFalse();
+}
+
+// Join the foreign keys of the last join that lead to one of models, or that
+// are related with addSelectRelated(). Return whether the last join is used.
+bool QQuerySetPrivate::buildJoins(QList<Join> &joins, const QSet<QModel *> &models, bool related, int depth)
 {
     // Model to explore
     Join &join = joins.last();
@@ -169,8 +366,11 @@ bool QQuerySetPrivate::buildJoins(QList<Join> &joins, bool useSelectedFields)
     // Allocate a table number for this model
     join.model->setTableNumber(joins.count());
 
-    // If one of the requested fields is in this model, we are useful
-    bool useful_join = _selected_models.contains(join.model);
+    // If one of the needed models is this one, we are useful
+    bool useful_join = models.contains(join.model);
+
+    if (depth >= _max_join_depth)
+        return useful_join;
 
     // Explore the foreign keys of this model
     QVector<QForeignKeyPrivate *> subkeys;
@@ -182,48 +382,38 @@ bool QQuerySetPrivate::buildJoins(QList<Join> &joins, bool useSelectedFields)
     {
         QForeignKeyPrivate *foreign_key = subkeys.at(i);
         QModel *target_model = foreign_key->value();
+        QField field(foreign_key, true);
 
-        // Ignore a field in the exclude list
-        if (_excluded_fields.contains(QField(foreign_key, true)))
+        // Ignore a field in the exclude list, or a target never instantiated
+        if (!target_model || _excluded_fields.contains(field))
             continue;
 
-        if (target_model)
+        // Create a new join
+        new_join.model = target_model;
+        new_join.parent_foreignkey = foreign_key;
+        new_join.accepts_null = (foreign_key->acceptsNull() || join.accepts_null);
+
+        // Add the join to the list of joins to explore, and keep it only if
+        // it is related or leads to a needed model
+        joins.append(new_join);
+
+        bool selected = (related && _related.contains(field));
+
+        if (buildJoins(joins, models, related, depth + 1) || selected)
         {
-            // Create a new join
-            new_join.model = target_model;
-            new_join.parent_foreignkey = foreign_key;
-            new_join.accepts_null = (foreign_key->acceptsNull() || join.accepts_null);
-
-            // Add the join to the list of joins to explore
-            joins.append(new_join);
-
-            // Explore the joint. If we restrict ourself to the fields in
-            // _selected_fields, don't join with a table that has no field in
-            // our list.
-            if (useSelectedFields)
-            {
-                if (!buildJoins(joins, useSelectedFields))
-                {
-                    // No field used in this join, remove it from the list
-                    joins.removeLast();
-                }
-                else
-                {
-                    useful_join = true;
-                }
-            }
-            else
-            {
-                // Inconditionnally build joins
-                buildJoins(joins, useSelectedFields);
-            }
+            useful_join = true;
+        }
+        else
+        {
+            // Nothing used in this join, remove it from the list
+            joins.removeLast();
         }
     }
 
     return useful_join;
 }
 
-QList<QQuerySetPrivate::Join> QQuerySetPrivate::buildSelectedFields(bool for_remove)
+QList<QQuerySetPrivate::Join> QQuerySetPrivate::buildSelectedFields()
 {
     // First join we always have
     QList<Join> joins;
@@ -235,16 +425,21 @@ QList<QQuerySetPrivate::Join> QQuerySetPrivate::buildSelectedFields(bool for_rem
 
     joins.append(start_join);
 
-    // Explore the model to build joins, but not when we remove as not all databases
-    // support that.
-    if (!for_remove)
-    {
-        buildJoins(joins, _selected_fields.count() != 0);
+    // Join the tables of the filters, the ordering and the selected fields,
+    // and the related ones when all the fields are selected
+    QSet<QModel *> models = filterModels();
 
-        // If we use a user-supplied _selected_fields list, we are done
-        if (_selected_fields.count() != 0)
-            return joins;
-    }
+    for (int i=0; i<_order_by.count(); ++i)
+        models.insert(_order_by.at(i).first.model());
+
+    for (int i=0; i<_columns.count(); ++i)
+        models.insert(_columns.at(i).model());
+
+    buildJoins(joins, models, _columns.count() == 0, 0);
+
+    // If we use a user-supplied list of fields, we are done
+    if (_columns.count() != 0)
+        return joins;
 
     // Add the fields of every join to the list of the fields
     for (int i=0; i<joins.count(); ++i)
@@ -256,39 +451,80 @@ QList<QQuerySetPrivate::Join> QQuerySetPrivate::buildSelectedFields(bool for_rem
         {
             const QField &field = join.model->field(j);
 
-            if (!_excluded_fields.contains(field))
-            {
-                _selected_fields.append(field);
-            }
+            if (_excluded_fields.contains(field))
+                continue;
+
+            // Lazy fields are loaded on first access, if ever accessed
+            if (field.d->isLazy() || _deferred_fields.contains(field) || narrowedOut(field))
+                _lazy_fields.append(field);
+            else
+                _columns.append(field);
         }
     }
 
+    // Column of the primary key identifying the row of each lazy field
+    for (int i=0; i<_lazy_fields.count(); ++i)
+    {
+        _lazy_pk_columns.append(_columns.indexOf(_lazy_fields.at(i).model()->pk()));
+    }
+
     // Return the joins so other methods can use them
     return joins;
 }
 
-QString QQuerySetPrivate::buildSelect()
+QList<QQuerySetPrivate::Join> QQuerySetPrivate::buildFilterJoins()
+{
+    QList<Join> joins;
+    Join start_join;
+
+    start_join.model = _model;
+    start_join.parent_foreignkey = NULL;
+    start_join.accepts_null = false;
+
+    joins.append(start_join);
+    buildJoins(joins, filterModels(), false, 0);
+
+    return joins;
+}
+
+QSet<QModel *> QQuerySetPrivate::filterModels() const
+{
+    // Walk the filters without generating SQL, only to see which models
+    // their fields belong to
+    QSet<QModel *> models;
+    QSqlWriter writer(NULL);
+
+    writer.collectModels(&models);
+
+    if (_where.isValid())
+        _where.writeSql(writer);
+
+    return models;
+}
+
+bool QQuerySetPrivate::filtersCrossTables() const
 {
-    QString rs;
+    QSet<QModel *> models = filterModels();
+
+    models.remove(_model);
 
+    return !models.isEmpty();
+}
+
+void QQuerySetPrivate::writeSelect(QSqlWriter &writer)
+{
     // Select all the selected fields
-    for (int i=0; i<_selected_fields.count(); ++i)
+    for (int i=0; i<_columns.count(); ++i)
     {
-        const QField &field = _selected_fields.at(i);
-
         if (i != 0)
-            rs += QLatin1String(", ");
+            writer << ", ";
 
-        rs += _driver->escapeIdentifier(field.fieldName(), QSqlDriver::FieldName);
+        writer.appendFieldName(_columns.at(i));
     }
-
-    return rs;
 }
 
-QString QQuerySetPrivate::buildFrom(const QList<Join> &joins, bool for_remove)
+void QQuerySetPrivate::writeFrom(QSqlWriter &writer, const QList<Join> &joins)
 {
-    QString rs;
-
     // Select from every table listed in joins
     for (int i=0; i<joins.count(); ++i)
     {
@@ -297,255 +533,1117 @@ QString QQuerySetPrivate::buildFrom(const QList<Join> &joins, bool for_remove)
 
         if (i == 0)
         {
-            // Just the table, without alias if we build a DELETE FROM
-            if (for_remove)
-            {
-                rs = _driver->escapeIdentifier(table->tableName(), QSqlDriver::TableName);
-            }
-            else
-            {
-                rs += QString("%0 AS T%1")
-                    .arg(_driver->escapeIdentifier(table->tableName(), QSqlDriver::TableName))
-                    .arg(table->tableNumber());
-            }
+            writer.appendTableName(table);
+            writer << " AS T" << table->tableNumber();
         }
         else
         {
             Q_ASSERT(join.parent_foreignkey != NULL && "Only the first join (the main table in fact) can have a NULL parent foreign key.");
 
-            rs += QString(" %0 JOIN %1 AS T%2 ON %3 = %4")
-                .arg(join.accepts_null ? "LEFT" : "INNER")
-                .arg(_driver->escapeIdentifier(table->tableName(), QSqlDriver::TableName))
-                .arg(table->tableNumber())
-                .arg(table->pk().fieldName())
-                .arg(QField(join.parent_foreignkey, true).fieldName());
+            writer << (join.accepts_null ? " LEFT JOIN " : " INNER JOIN ");
+            writer.appendTableName(table);
+            writer << " AS T" << table->tableNumber() << " ON ";
+            writer.appendFieldName(table->pk());
+            writer << " = ";
+            writer.appendFieldName(QField(join.parent_foreignkey, true));
         }
     }
-
-    return rs;
 }
 
-QString QQuerySetPrivate::buildWhere(bool for_remove)
+void QQuerySetPrivate::writeWhere(QSqlWriter &writer)
 {
-    QString rs;
+    if (_where.isValid())
+    {
+        writer << " WHERE ";
+        _where.writeSql(writer);
+    }
+}
 
-    for (int i=0; i<_filter.count(); ++i)
+void QQuerySetPrivate::writeSingleTableWhere(QSqlWriter &writer)
+{
+    // UPDATE and DELETE statements name the fields of their table without alias
+    if (!filtersCrossTables())
     {
-        if (i == 0)
-            rs = QLatin1String(" WHERE ");
-        else
-            rs += QLatin1String(" AND ");
+        writeWhere(writer);
+        return;
+    }
 
-        QString part = _filter.at(i).sql(_driver);
+    // The filters use fields of other tables, that cannot be joined in an
+    // UPDATE or a DELETE. Select the primary keys of the matching rows in a
+    // subquery that has the joins.
+    QList<Join> joins = buildFilterJoins();
+    bool mysql = (writer.dialect() == QtOrmDatabase::MySQL);
 
-        // If we delete, remove all allusions to T0
-        if (for_remove)
-        {
-            part.remove(QString("%1.")
-                        .arg(_driver->escapeIdentifier("T0", QSqlDriver::TableName)));
-        }
+    writer << " WHERE ";
+    writer.appendName(_model->pk());
+    writer << " IN (";
 
-        rs.append(part);
+    if (mysql)
+    {
+        // MySQL refuses a subquery on the modified table, unless it is
+        // materialized in a derived table
+        writer << "SELECT ";
+        writer.appendName(_model->pk());
+        writer << " FROM (";
     }
 
-    return rs;
+    writer.setAliasPolicy(QSqlWriter::TableAliases);
+    writer << "SELECT ";
+    writer.appendFieldName(_model->pk());
+    writer << " FROM ";
+    writeFrom(writer, joins);
+    writeWhere(writer);
+    writer.setAliasPolicy(QSqlWriter::NoAliases);
+
+    if (mysql)
+        writer << ") AS qtorm_s";
+
+    writer << ')';
 }
 
-QString QQuerySetPrivate::buildOrderBy()
+void QQuerySetPrivate::writeOrderBy(QSqlWriter &writer)
 {
-    QString rs;
-
     // Build the ORDER BY part
     for (int i=0; i<_order_by.count(); ++i)
     {
-        if (i == 0)
-            rs = QLatin1String(" ORDER BY ");
-        else
-            rs += QLatin1String(", ");
-
-        rs += _driver->escapeIdentifier(_order_by.at(i).first.fieldName(), QSqlDriver::FieldName);
-        rs += _order_by.at(i).second ? " ASC" : " DESC";
+        writer << (i == 0 ? " ORDER BY " : ", ");
+        writer.appendFieldName(_order_by.at(i).first);
+        writer << (_order_by.at(i).second ? " ASC" : " DESC");
     }
-
-    return rs;
 }
 
-QString QQuerySetPrivate::buildLimit()
+void QQuerySetPrivate::writeLimit(QSqlWriter &writer)
 {
-    QString rs;
-
     // Build the LIMIT/OFFSET part
     if (_limit)
-        rs = QString(" LIMIT %0").arg(_limit);
+        writer << " LIMIT " << _limit;
     if (_offset)
-        rs += QString(" OFFSET %0").arg(_offset);
+        writer << " OFFSET " << _offset;
+}
 
-    return rs;
+void QQuerySetPrivate::setupWriter(QSqlWriter &writer)
+{
+    writer.setDialect(_dialect);
+    writer.setTemporaryTablePrefix(QString("qtorm_in_%1_").arg((quintptr)this, 0, 16));
+}
+
+bool QQuerySetPrivate::createTemporaryTables(const QList<QSqlWriter::TemporaryTable> &tables)
+{
+    int chunk_size = QtOrmDatabase::maxBindValues(_db);
+
+    for (int i=0; i<tables.count(); ++i)
+    {
+        const QSqlWriter::TemporaryTable &table = tables.at(i);
+        QString name = _driver->escapeIdentifier(table.name, QSqlDriver::TableName);
+        QSqlQuery query(_db);
+
+        if (!query.exec(QString("CREATE TEMPORARY TABLE %1 (v %2);").arg(name, table.type)))
+        {
+            qDebug() << "Cannot create the temporary table" << name << ":" << query.lastError();
+            return false;
+        }
+
+        _temporary_tables.append(name);
+
+        // Load the values, as many per statement as the database can bind. All
+        // the chunks but the last one have the same size and reuse the statement.
+        int prepared_size = 0;
+
+        for (int start=0; start<table.values.count(); start += chunk_size)
+        {
+            int size = qMin(chunk_size, table.values.count() - start);
+
+            if (size != prepared_size)
+            {
+                QSqlWriter insert(_driver, 32 + size * 5);
+
+                insert << "INSERT INTO " << name << " (v) VALUES ";
+
+                for (int j=0; j<size; ++j)
+                {
+                    if (j != 0)
+                        insert << ", ";
+
+                    insert << '(';
+                    insert.appendValue(QVariant());
+                    insert << ')';
+                }
+
+                query.prepare(insert.sql());
+                prepared_size = size;
+            }
+
+            for (int j=0; j<size; ++j)
+                query.addBindValue(table.values.at(start + j));
+
+            if (!query.exec())
+            {
+                qDebug() << "Cannot fill the temporary table" << name << ":" << query.lastError();
+                return false;
+            }
+        }
+    }
+
+    return true;
 }
 
-void QQuerySetPrivate::build(bool for_remove)
+void QQuerySetPrivate::dropTemporaryTables()
+{
+    for (int i=0; i<_temporary_tables.count(); ++i)
+    {
+        QSqlQuery query(_db);
+
+        if (!query.exec(QString("DROP TABLE %1;").arg(_temporary_tables.at(i))))
+            qDebug() << "Cannot drop the temporary table" << _temporary_tables.at(i) << ":" << query.lastError();
+    }
+
+    _temporary_tables.clear();
+}
+
+// The values, if given, are the fields selected by values() instead of the model
+void QQuerySetPrivate::build(bool for_remove, const QVector<QField> *values)
 {
     if (_built)
         return;
 
     _built = true;
+    _prepared = false;
+    _kind = (for_remove ? QtOrmInstrumentation::Delete : QtOrmInstrumentation::Select);
 
-    // Joins used throughout
-    QList<QQuerySetPrivate::Join> joins = buildSelectedFields(for_remove);
+    bool instrumented = QtOrmInstrumentation::isEnabled();
+    qint64 start = (instrumented ? QtOrmInstrumentation::timestamp() : 0);
 
+    simplifyFilters();
 
-    // Build the query
-    QString q;
+    // Build the query in one buffer, large enough for the previous query
+    QSqlWriter writer(_driver, _sql_size);
+
+    setupWriter(writer);
+
+    // Joins used throughout
+    QList<QQuerySetPrivate::Join> joins;
 
     if (for_remove)
     {
-        q = QString("DELETE FROM %2%3;")
-            .arg(buildFrom(joins, true))
-            .arg(buildWhere(true));
+        writer.setAliasPolicy(QSqlWriter::NoAliases);
+        writer << "DELETE FROM ";
+        writer.appendTableName(_model);
+        writeSingleTableWhere(writer);
+        writer << ';';
     }
     else
     {
-        q = QString("SELECT %1 FROM %2%3%4%5")
-            .arg(buildSelect())
-            .arg(buildFrom(joins, false))
-            .arg(buildWhere(false))
-            .arg(buildOrderBy())
-            .arg(buildLimit());
+        bool learn = (!values && QtOrmDatabase::relationLearning() && _relation_loading != QQuerySet::ExplicitRelations);
+        bool project = (!values && QtOrmDatabase::adaptiveProjection() && _selected_fields.count() == 0);
+
+        // Nothing is left from the previous build, the columns may have been auto-selected
+        releaseLazyFields();
+
+        _shape = (learn || project ? shape() : QString());
+        _projection = FullProjection;
+
+        // The learned relations are added to copies, the shape stays the one of the user
+        _columns = (values ? *values : _selected_fields);
+        _related = _select_related;
+        _lazy_fields.clear();
+        _lazy_pk_columns.clear();
+
+        if (learn)
+            applyLearnedRelations();
+
+        if (project)
+            applyLearnedProjection();
+
+        joins = buildSelectedFields();
+
+        writer << "SELECT ";
+        writeSelect(writer);
+        writer << " FROM ";
+        writeFrom(writer, joins);
+        writeWhere(writer);
+        writeOrderBy(writer);
+        writeLimit(writer);
     }
 
-    // Prepare the query
+    _sql_size = qMax(_sql_size, writer.size());
+    _sql = writer.sql();
+    _values = writer.values();
+    _pending_tables = writer.temporaryTables();
+
+    if (QIndexAdvisor::isEnabled())
+        buildAccessPaths(joins);
+
+    if (instrumented)
+        QtOrmInstrumentation::record(QtOrmInstrumentation::Build, _kind, _model->tableName(), _sql, start);
+}
+
+bool QQuerySetPrivate::prepare()
+{
+    if (_prepared)
+        return true;
+
+    bool instrumented = QtOrmInstrumentation::isEnabled();
+    qint64 start = (instrumented ? QtOrmInstrumentation::timestamp() : 0);
+
+    // Prepare the query, once the tables it uses exist
     _query.finish();
+    dropTemporaryTables();
+
+    if (!createTemporaryTables(_pending_tables))
+        return false;
 
-    if (!_query.prepare(q))
+    if (!_query.prepare(_sql))
     {
-        qDebug() << "Cannot prepare the query \"" << _query.lastQuery() << "\" :" << _query.lastError();
+        qDebug() << "Cannot prepare the query \"" << _sql << "\" :" << _query.lastError();
+        return false;
     }
+
+    if (instrumented)
+        QtOrmInstrumentation::record(QtOrmInstrumentation::Prepare, _kind, _model->tableName(), _sql, start);
+
+    _prepared = true;
+
+    return true;
 }
 
-void QQuerySetPrivate::exec()
+bool QQuerySetPrivate::exec()
 {
     if (_executed)
-        return;
+        return (_never_matches || _query.isActive());
 
     _executed = true;
+    _window.clear();
+    _window_pos = -1;
 
-    // Bind the values
-    QVariantList values;
+    // The filters cannot match any row, don't ask the database
+    if (_never_matches)
+        return true;
 
-    for (int i=0; i<_filter.count(); ++i)
-    {
-        _filter.at(i).bindValues(values);
-    }
+    if (!prepare())
+        return false;
 
-    for (int i=0; i<values.count(); ++i)
+    // Bind the values
+    for (int i=0; i<_values.count(); ++i)
     {
-        _query.addBindValue(values.at(i));
+        _query.addBindValue(_values.at(i));
     }
 
-    if (!_query.exec())
+    bool advise = (QIndexAdvisor::isEnabled() && _access_paths.count() != 0);
+    qint64 usecs = 0;
+    bool rs = QtOrmDatabase::exec(_db, _query, _sql, _values, _kind, _model->tableName(), advise ? &usecs : NULL);
+
+    if (!rs)
     {
         qDebug() << "Cannot execute the query \"" << _query.lastQuery() << "\" :" << _query.lastError();
     }
+
+    if (advise)
+        QIndexAdvisor::record(_access_paths, usecs);
+
+    return rs;
 }
 
-bool QQuerySetPrivate::next()
+QQueryPlan QQuerySetPrivate::explain()
 {
-    if (!_query.next())
-        return false;
+    build(false);
 
-    // Get a row from the query and populate the model with it
-    for (int i=0; i<_selected_fields.count(); ++i)
+    // The temporary tables of the query must exist
+    if (_never_matches || !prepare())
+        return QQueryPlan();
+
+    return QQueryPlan::explain(_db, _sql, _values, true);
+}
+
+static qint64 decodedSize(const QVariant &value)
+{
+    switch (value.type())
     {
-        _selected_fields[i].setRawData(_query.value(i));
+        case QVariant::String:
+            return value.toString().size() * sizeof(QChar);
+        case QVariant::ByteArray:
+            return value.toByteArray().size();
+        case QVariant::Invalid:
+            return 0;
+        default:
+            return sizeof(qint64);
     }
-
-    return true;
 }
 
-bool QQuerySetPrivate::update(int *affectedRows)
+bool QQuerySetPrivate::next()
 {
-    // Build the list of fields to update
-    QString fields_part;
-    QVariantList values;
-    bool first = true;
+    if (_never_matches)
+        return false;
 
-    for (int i=0; i<_model->fieldsCount(); ++i)
+    bool instrumented = QtOrmInstrumentation::isEnabled();
+    qint64 start = (instrumented ? QtOrmInstrumentation::timestamp() : 0);
+    qint64 bytes = 0;
+
+    if (_lazy_fields.count() == 0)
     {
-        const QField &f = _model->field(i);
+        bool has_row = _query.next();
 
-        if (f.isModified())
+        if (instrumented)
         {
-            if (!first)
-                fields_part += QLatin1String(", ");
+            QtOrmInstrumentation::record(QtOrmInstrumentation::Fetch, _kind, _model->tableName(), _query.lastQuery(), start, has_row ? 1 : 0);
+            start = QtOrmInstrumentation::timestamp();
+        }
 
-            fields_part += f.fieldName();
-            const QAssign &assign = f.assignation();
+        if (!has_row)
+            return false;
 
-            if (!assign.isValid())
-            {
-                // No assignation, just an immediate value
-                fields_part += QLatin1String(" = ?");
-                values.append(f.data());
-            }
-            else
-            {
-                // An assignation, append its SQL
-                fields_part += QLatin1String(" = ");
-                fields_part += assign.sql(_driver);
-                assign.bindValues(values);
-            }
+        // Get a row from the query and populate the model with it
+        for (int i=0; i<_columns.count(); ++i)
+        {
+            if (instrumented)
+                bytes += decodedSize(_query.value(i));
 
-            first = false;
+            _columns[i].setRawData(_query.value(i));
         }
-    }
 
-    if (fields_part.isEmpty())
-        return true;
+        if (_projection == LearningProjection)
+            watchReads();
 
-    // Whole SQL
-    QString sql = QString("UPDATE %0 AS T0 SET %1%2;")
-        .arg(_driver->escapeIdentifier(_model->tableName(), QSqlDriver::TableName))
-        .arg(fields_part)
-        .arg(buildWhere(false));
+        if (instrumented)
+            QtOrmInstrumentation::record(QtOrmInstrumentation::Decode, _kind, _model->tableName(), _query.lastQuery(), start, 1, bytes);
 
-    // Bind values for where
-    for (int i=0; i<_filter.count(); ++i)
-    {
-        _filter.at(i).bindValues(values);
+        return true;
     }
 
-    // Prepare and run the query
-    _query.finish();
-    _query.prepare(sql);
+    // Rows are read by windows, the lazy fields are loaded for a whole window
+    if (++_window_pos >= _window.count() && !fillWindow())
+        return false;
+
+    if (instrumented)
+        start = QtOrmInstrumentation::timestamp();
 
-    for (int i=0; i<values.count(); ++i)
+    const QVariantList &row = _window.at(_window_pos);
+
+    for (int i=0; i<_columns.count(); ++i)
     {
-        _query.addBindValue(values.at(i));
+        if (instrumented)
+            bytes += decodedSize(row.at(i));
+
+        _columns[i].setRawData(row.at(i));
     }
 
-    if (!_query.exec())
+    for (int i=0; i<_lazy_fields.count(); ++i)
     {
-        qDebug() << _query.lastError();
-        return false;
+        QFieldPrivate *field = _lazy_fields.at(i).d;
+
+        field->setLoaded(false);
+        field->setLoader(this);
     }
 
-    if (affectedRows)
-        *affectedRows = _query.numRowsAffected();
+    if (_projection == LearningProjection)
+        watchReads();
+
+    if (instrumented)
+        QtOrmInstrumentation::record(QtOrmInstrumentation::Decode, _kind, _model->tableName(), _query.lastQuery(), start, 1, bytes);
 
     return true;
 }
 
-void QQuerySetPrivate::reset()
+void QQuerySetPrivate::buildAccessPaths(const QList<Join> &joins)
 {
-    _built = false;
-    _executed = false;
+    QHash<QModel *, QStringList> equalities, ranges;
+    QList<QWhere> operands;
 
-    _selected_fields.clear();
-    _excluded_fields.clear();
-    _select_related.clear();
+    _access_paths.clear();
+
+    if (_where.isValid() && !QWherePrivate::dptr(_where)->operands(QWhere::And, operands))
+        operands.append(_where);
+
+    // Columns compared to values, and the other conditions on one column
+    for (int i=0; i<operands.count(); ++i)
+    {
+        const QWhere &operand = operands.at(i);
+        QField field;
+        QVariantList values;
+
+        if (QWherePrivate::dptr(operand)->fieldValues(field, values))
+        {
+            equalities[field.model()].append(field.name());
+            continue;
+        }
+
+        QList<QField> fields;
+        QSqlWriter writer(NULL);
+        bool one_column = true;
+
+        writer.collectFields(&fields);
+        operand.writeSql(writer);
+
+        for (int j=1; j<fields.count() && one_column; ++j)
+            one_column = (fields.at(j) == fields.at(0));
+
+        if (fields.count() != 0 && one_column)
+            ranges[fields.at(0).model()].append(fields.at(0).name());
+    }
+
+    // An index can also give the rows of the main table in order
+    if (_order_by.count() != 0 && _order_by.at(0).first.model() == _model)
+        ranges[_model].append(_order_by.at(0).first.name());
+
+    QList<QModel *> models = equalities.keys();
+
+    for (int i=0; i<ranges.keys().count(); ++i)
+    {
+        if (!equalities.contains(ranges.keys().at(i)))
+            models.append(ranges.keys().at(i));
+    }
+
+    for (int i=0; i<models.count(); ++i)
+    {
+        QModel *model = models.at(i);
+        QStringList columns = equalities.value(model);
+        QStringList model_ranges = ranges.value(model);
+        QIndexAdvisor::AccessPath path;
+
+        columns.removeDuplicates();
+        qSort(columns);
+
+        path.table = model->tableName();
+        path.pk = model->pk().name();
+        path.equalities = columns.count();
+        path.columns = columns;
+
+        if (model_ranges.count() != 0 && !columns.contains(model_ranges.at(0)))
+            path.columns.append(model_ranges.at(0));
+
+        _access_paths.append(path);
+    }
+
+    // Joins look the rows up by foreign key
+    for (int i=0; i<joins.count(); ++i)
+    {
+        QForeignKeyPrivate *foreign_key = joins.at(i).parent_foreignkey;
+
+        if (!foreign_key)
+            continue;
+
+        QIndexAdvisor::AccessPath path;
+
+        path.table = foreign_key->model()->tableName();
+        path.pk = foreign_key->model()->pk().name();
+        path.columns.append(foreign_key->name());
+        path.equalities = 1;
+
+        _access_paths.append(path);
+    }
+}
+
+bool QQuerySetPrivate::fillWindow()
+{
+    int columns = _columns.count();
+    bool instrumented = QtOrmInstrumentation::isEnabled();
+    qint64 start = (instrumented ? QtOrmInstrumentation::timestamp() : 0);
+
+    _window.clear();
+    _window_values.fill(QVariantList(), _lazy_fields.count());
+    _window_pos = 0;
+
+    while (_window.count() < WindowSize && _query.next())
+    {
+        QVariantList row;
+
+        for (int i=0; i<columns; ++i)
+            row.append(_query.value(i));
+
+        _window.append(row);
+    }
+
+    if (instrumented)
+        QtOrmInstrumentation::record(QtOrmInstrumentation::Fetch, _kind, _model->tableName(), _query.lastQuery(), start, _window.count());
+
+    return (_window.count() != 0);
+}
+
+bool QQuerySetPrivate::loadField(QFieldPrivate *field)
+{
+    int index = -1;
+
+    // Large values are not loaded for a whole window, only for the current row
+    if (field->isLazy())
+        return false;
+
+    for (int i=0; i<_lazy_fields.count(); ++i)
+    {
+        if (_lazy_fields.at(i).d == field)
+        {
+            index = i;
+            break;
+        }
+    }
+
+    // Past the end of the rows, or without primary key to match the rows
+    if (index == -1 || _window_pos >= _window.count() || _lazy_pk_columns.at(index) == -1)
+        return false;
+
+    if (_projection == NarrowedProjection)
+        _fields_read.insert(field);
+
+    if (_window_values.at(index).count() == 0 && !loadWindow(index))
+        return false;
+
+    field->fromData(_window_values.at(index).at(_window_pos));
+    return true;
+}
+
+bool QQuerySetPrivate::loadWindow(int lazyField)
+{
+    const QField &field = _lazy_fields.at(lazyField);
+    const QField &pk = field.model()->pk();
+    int pk_column = _lazy_pk_columns.at(lazyField);
+
+    // Rows of the window by primary key, a joined row can appear several times
+    QMultiHash<QString, int> positions;
+    QVariantList pks, values;
+
+    for (int i=0; i<_window.count(); ++i)
+    {
+        const QVariant &value = _window.at(i).at(pk_column);
+        QString key = value.toString();
+
+        if (!value.isNull() && !positions.contains(key))
+            pks.append(value);
+
+        positions.insert(key, i);
+        values.append(QVariant());
+    }
+
+    if (pks.count() != 0)
+    {
+        QSqlWriter writer(_driver, 64 + pks.count() * 3);
+        QSqlQuery query(_db);
+
+        writer.setAliasPolicy(QSqlWriter::NoAliases);
+        writer.setDialect(_dialect);
+
+        writer << "SELECT ";
+        writer.appendName(pk);
+        writer << ", ";
+        writer.appendName(field);
+        writer << " FROM ";
+        writer.appendTableName(field.model());
+        writer << " WHERE ";
+        writer.appendName(pk);
+        writer << " IN (";
+        writer.appendValues(pks);
+        writer << ");";
+
+        query.prepare(writer.sql());
+
+        for (int i=0; i<writer.values().count(); ++i)
+            query.addBindValue(writer.values().at(i));
+
+        if (!QtOrmDatabase::exec(_db, query, writer.sql(), writer.values(), QtOrmInstrumentation::Select, field.model()->tableName()))
+        {
+            qDebug() << "Cannot load the deferred field" << field.name() << ":" << query.lastError();
+            return false;
+        }
+
+        while (query.next())
+        {
+            QList<int> rows = positions.values(query.value(0).toString());
+
+            for (int i=0; i<rows.count(); ++i)
+                values[rows.at(i)] = query.value(1);
+        }
+    }
+
+    _window_values[lazyField] = values;
+    return true;
+}
+
+void QQuerySetPrivate::releaseLazyFields()
+{
+    // The fields may outlive this query set
+    for (int i=0; i<_lazy_fields.count(); ++i)
+    {
+        QFieldPrivate *field = _lazy_fields.at(i).d;
+
+        if (field->loader() == this)
+            field->setLoader(NULL);
+    }
+
+    for (int i=0; i<_columns.count() && _projection == LearningProjection; ++i)
+    {
+        QFieldPrivate *field = _columns.at(i).d;
+
+        if (field->loader() == this)
+            field->setLoader(NULL);
+    }
+}
+
+void QQuerySetPrivate::fieldRead(QFieldPrivate *field)
+{
+    _fields_read.insert(field);
+}
+
+void QQuerySetPrivate::watchReads()
+{
+    for (int i=0; i<_columns.count(); ++i)
+    {
+        QFieldPrivate *field = _columns.at(i).d;
+
+        field->setLoader(this);
+        field->watchRead();
+    }
+}
+
+bool QQuerySetPrivate::execValues(const QVector<QField> &fields)
+{
+    // The values share the query of the model, next() would start again from the first row
+    if (_iterating)
+    {
+        qDebug() << "values() cannot be called while the query set is iterated by next()";
+        return false;
+    }
+
+    // Select only the given fields, the query of the model is built again by next()
+    _built = false;
+    _executed = false;
+
+    build(false, &fields);
+
+    bool rs = exec();
+
+    _built = false;
+    _executed = false;
+
+    return rs;
+}
+
+bool QQuerySetPrivate::nextValues()
+{
+    // Rows are read by the caller, the fields of the model are left untouched
+    return (!_never_matches && _query.next());
+}
+
+QVariant QQuerySetPrivate::value(int column) const
+{
+    return _query.value(column);
+}
+
+bool QQuerySetPrivate::update(int *affectedRows)
+{
+    bool instrumented = QtOrmInstrumentation::isEnabled();
+    qint64 start = (instrumented ? QtOrmInstrumentation::timestamp() : 0);
+    QSqlWriter writer(_driver, _sql_size);
+    bool first = true;
+
+    setupWriter(writer);
+    writer.setAliasPolicy(QSqlWriter::NoAliases);
+    writer << "UPDATE ";
+    writer.appendTableName(_model);
+    writer << " SET ";
+
+    // Build the list of fields to update
+    for (int i=0; i<_model->fieldsCount(); ++i)
+    {
+        const QField &f = _model->field(i);
+
+        if (f.isModified())
+        {
+            if (!first)
+                writer << ", ";
+
+            writer.appendName(f);
+            writer << " = ";
+
+            const QAssign &assign = f.assignation();
+
+            if (!assign.isValid())
+            {
+                // No assignation, just an immediate value
+                writer.appendValue(f.data());
+            }
+            else
+            {
+                // An assignation, append its SQL
+                assign.writeSql(writer);
+            }
+
+            first = false;
+        }
+    }
+
+    if (first)
+        return true;
+
+    simplifyFilters();
+
+    if (_never_matches)
+    {
+        if (affectedRows)
+            *affectedRows = 0;
+
+        return true;
+    }
+
+    writeSingleTableWhere(writer);
+    writer << ';';
+
+    if (instrumented)
+    {
+        QtOrmInstrumentation::record(QtOrmInstrumentation::Build, QtOrmInstrumentation::Update, _model->tableName(), writer.sql(), start);
+        start = QtOrmInstrumentation::timestamp();
+    }
+
+    // Prepare and run the query, it replaces the one of the model
+    _prepared = false;
+    _query.finish();
+    dropTemporaryTables();
+
+    if (!createTemporaryTables(writer.temporaryTables()))
+        return false;
+
+    _query.prepare(writer.sql());
+
+    if (instrumented)
+        QtOrmInstrumentation::record(QtOrmInstrumentation::Prepare, QtOrmInstrumentation::Update, _model->tableName(), writer.sql(), start);
+
+    for (int i=0; i<writer.values().count(); ++i)
+    {
+        _query.addBindValue(writer.values().at(i));
+    }
+
+    bool advise = QIndexAdvisor::isEnabled();
+    qint64 usecs = 0;
+
+    if (advise)
+        buildAccessPaths(QList<Join>());
+
+    if (!QtOrmDatabase::exec(_db, _query, writer.sql(), writer.values(), QtOrmInstrumentation::Update,
+                             _model->tableName(), advise ? &usecs : NULL))
+    {
+        qDebug() << _query.lastError();
+        return false;
+    }
+
+    if (advise)
+        QIndexAdvisor::record(_access_paths, usecs);
+
+    if (affectedRows)
+        *affectedRows = _query.numRowsAffected();
+
+    return true;
+}
+
+void QQuerySetPrivate::reset()
+{
+    _built = false;
+    _executed = false;
+
+    releaseLazyFields();
+
+    _selected_fields.clear();
+    _columns.clear();
+    _lazy_fields.clear();
+    _lazy_pk_columns.clear();
+    _excluded_fields.clear();
+    _deferred_fields.clear();
+    _window.clear();
+    _window_values.clear();
+    _window_pos = -1;
+    _select_related.clear();
+    _related.clear();
     _filter.clear();
+    _where = QWhere();
+    _never_matches = false;
     _order_by.clear();
     _query.finish();
+    dropTemporaryTables();
+    setIterating(false);
+}
+
+// Called for every row, and when there are no more rows
+void QQuerySetPrivate::setIterating(bool iterating)
+{
+    if (iterating)
+        _rows_iterated++;
+
+    if (iterating == _iterating)
+        return;
+
+    _iterating = iterating;
+
+    if (iterating)
+    {
+        int threshold = QtOrmDatabase::lazyLoadThreshold();
+
+        if (iterations_nested++ == 0)
+            iteration_watched = (threshold > 0 && ++iterations_seen % QtOrmDatabase::lazyLoadSampling() == 0);
+
+        _watched = (threshold > 0 && iteration_watched);
+        _learning = (_relation_loading == QQuerySet::LearnRelations && QtOrmDatabase::relationLearning() && !_shape.isEmpty());
+
+        if (_watched || _learning)
+        {
+            _outer_iteration = iterating_queryset;
+            _inner_iteration = NULL;
+
+            if (_outer_iteration)
+                _outer_iteration->_inner_iteration = this;
+
+            iterating_queryset = this;
+            _lazy_loads.clear();
+        }
+
+        _fields_read.clear();
+    }
+    else
+    {
+        iterations_nested--;
+
+        if (_learning)
+            learnRelations();
+
+        if (_projection != FullProjection)
+            learnProjection();
+
+        // Unlink from the list, a loop left with break can end after the
+        // query sets started inside it
+        if (_watched || _learning)
+        {
+            if (_inner_iteration)
+                _inner_iteration->_outer_iteration = _outer_iteration;
+            else
+                iterating_queryset = _outer_iteration;
+
+            if (_outer_iteration)
+                _outer_iteration->_inner_iteration = _inner_iteration;
+        }
+
+        _watched = false;
+        _learning = false;
+        _outer_iteration = NULL;
+        _inner_iteration = NULL;
+    }
+
+    _rows_iterated = (iterating ? 1 : 0);
+}
+
+void QQuerySetPrivate::appendShapeField(QString &rs, char prefix, const QField &field)
+{
+    rs += QLatin1Char(prefix) + field.model()->tableName() + QLatin1Char('.') + field.name();
+}
+
+QString QQuerySetPrivate::shape() const
+{
+    // What the query set loads and filters on, whatever the values
+    QList<QField> filter_fields;
+    QSqlWriter writer(NULL);
+    QString rs = _model->tableName();
+
+    writer.collectFields(&filter_fields);
+
+    if (_where.isValid())
+        _where.writeSql(writer);
+
+    for (int i=0; i<_selected_fields.count(); ++i)
+        appendShapeField(rs, ',', _selected_fields.at(i));
+
+    for (int i=0; i<_select_related.count(); ++i)
+        appendShapeField(rs, '+', _select_related.at(i));
+
+    for (QSet<QField>::const_iterator it = _excluded_fields.constBegin(); it != _excluded_fields.constEnd(); ++it)
+        appendShapeField(rs, '-', *it);
+
+    for (int i=0; i<filter_fields.count(); ++i)
+        appendShapeField(rs, '?', filter_fields.at(i));
+
+    for (int i=0; i<_order_by.count(); ++i)
+        appendShapeField(rs, '^', _order_by.at(i).first);
+
+    if (!_tag.isEmpty())
+        rs += QLatin1Char('@') + _tag;
+
+    return rs;
+}
+
+void QQuerySetPrivate::applyLearnedRelations()
+{
+    QStringList names;
+
+    relation_stats_mutex.lock();
+
+    QHash<QString, RelationStats>::const_iterator it = relation_stats.constFind(_shape);
+
+    if (it != relation_stats.constEnd() && it.value().rows >= MinRelationRows)
+    {
+        const RelationStats &stats = it.value();
+
+        for (QHash<QString, double>::const_iterator load = stats.loads.constBegin(); load != stats.loads.constEnd(); ++load)
+        {
+            if (load.value() >= stats.rows * RelationLoadRatio)
+                names.append(load.key());
+        }
+    }
+
+    relation_stats_mutex.unlock();
+
+    if (names.isEmpty())
+        return;
+
+    QVector<QForeignKeyPrivate *> foreign_keys;
+
+    _model->getForeignKeys(foreign_keys);
+
+    for (int i=0; i<foreign_keys.count(); ++i)
+    {
+        QForeignKeyPrivate *foreign_key = foreign_keys.at(i);
+        QField field(foreign_key, true);
+
+        if (!names.contains(foreign_key->name()) || _related.contains(field) || _excluded_fields.contains(field))
+            continue;
+
+        _related.append(field);
+
+        // With a list of fields, only the tables having selected fields are joined
+        if (_columns.contains(field))
+        {
+            QModel *target = foreign_key->value();
+
+            for (int j=0; j<target->fieldsCount(); ++j)
+                _columns.append(target->field(j));
+        }
+    }
+}
+
+void QQuerySetPrivate::learnRelations()
+{
+    QVector<QForeignKeyPrivate *> foreign_keys;
+    QString prefix = _model->tableName() + QLatin1Char('.');
+
+    _model->getForeignKeys(foreign_keys);
+
+    QMutexLocker locker(&relation_stats_mutex);
+    QHash<QString, RelationStats>::iterator it = relation_stats.find(_shape);
+
+    if (it == relation_stats.end())
+    {
+        // Remember only the shapes loading foreign keys one by one
+        if (_lazy_loads.isEmpty())
+            return;
+
+        it = relation_stats.insert(_shape, RelationStats());
+    }
+
+    RelationStats &stats = it.value();
+
+    stats.rows = stats.rows * RelationDecay + _rows_iterated;
+
+    for (QHash<QString, double>::iterator load = stats.loads.begin(); load != stats.loads.end(); ++load)
+        load.value() *= RelationDecay;
+
+    // Only the foreign keys of the rows of this query set can be joined
+    for (int i=0; i<foreign_keys.count(); ++i)
+    {
+        int count = _lazy_loads.value(prefix + foreign_keys.at(i)->name());
+
+        if (count != 0)
+            stats.loads[foreign_keys.at(i)->name()] += count;
+    }
+}
+
+void QQuerySetPrivate::applyLearnedProjection()
+{
+    QMutexLocker locker(&projection_stats_mutex);
+    QHash<QString, ProjectionStats>::const_iterator it = projection_stats.constFind(_shape);
+
+    if (it == projection_stats.constEnd() || it.value().executions < ProjectionLearningExecutions)
+    {
+        _projection = LearningProjection;
+        return;
+    }
+
+    _projection = NarrowedProjection;
+    _projection_read = it.value().read;
+}
+
+void QQuerySetPrivate::learnProjection()
+{
+    QMutexLocker locker(&projection_stats_mutex);
+    ProjectionStats &stats = projection_stats[_shape];
+
+    if (_projection == LearningProjection)
+        stats.executions++;
+
+    // The fields loaded on demand are selected again by the next executions
+    for (QSet<QFieldPrivate *>::const_iterator it = _fields_read.constBegin(); it != _fields_read.constEnd(); ++it)
+        stats.read.insert((*it)->model()->tableName() + QLatin1Char('.') + (*it)->name());
+
+    _fields_read.clear();
+}
+
+bool QQuerySetPrivate::narrowedOut(const QField &field) const
+{
+    // The keys identify the rows and build the joins, they are always selected
+    if (_projection != NarrowedProjection || field.d->primaryKey() || field.d->isForeignKey())
+        return false;
+
+    return !_projection_read.contains(field.d->model()->tableName() + QLatin1Char('.') + field.d->name());
+}
+
+// Frames of the code accessing a foreign key, the ORM ones skipped
+static QString callSite()
+{
+#if defined(__GLIBC__)
+    void *frames[16];
+    int count = backtrace(frames, 16);
+    char **symbols = backtrace_symbols(frames, count);
+    QStringList rs;
+
+    if (!symbols)
+        return QString();
+
+    // Skip the frames up to QForeignKeyPrivate::fillCache() and the
+    // QForeignKey methods that called it, whatever was inlined. All the
+    // frames but callSite() itself are kept if none is found.
+    int first = 0;
+
+    while (first < count && !strstr(symbols[first], "QForeignKey"))
+        ++first;
+
+    if (first == count)
+        first = 1;
+
+    while (first < count && strstr(symbols[first], "QForeignKey"))
+        ++first;
+
+    for (int i=first; i<count; ++i)
+        rs.append(QString::fromLocal8Bit(symbols[i]));
+
+    free(symbols);
+
+    return rs.join(QLatin1String("\n    "));
+#else
+    return QString();
+#endif
+}
+
+void QQuerySetPrivate::foreignKeyLoaded(const QFieldPrivate *field, const QModel *target)
+{
+    QQuerySetPrivate *queryset = iterating_queryset;
+
+    if (!queryset)
+        return;
+
+    QString name = field->model()->tableName() + QLatin1Char('.') + field->name();
+    int count = ++queryset->_lazy_loads[name];
+
+    // Warn once per foreign key and iteration
+    if (!queryset->_watched || count != QtOrmDatabase::lazyLoadThreshold())
+        return;
+
+    QString site = (queryset->_tag.isEmpty() ? callSite() : queryset->_tag);
+
+    qDebug() << "N+1 queries:" << count << "rows of" << target->tableName()
+             << "loaded one by one through the foreign key" << name
+             << "while iterating a query set of" << queryset->_model->tableName()
+             << (site.isEmpty() ? QString() : QLatin1String("at ") + site);
+    qDebug() << "Load it with the main query using QQuerySet::addSelectRelated()";
 }
 
 /*
@@ -593,6 +1691,11 @@ void QQuerySet::excludeField(const QField &field)
     d->excludeField(field);
 }
 
+void QQuerySet::deferField(const QField &field)
+{
+    d->deferField(field);
+}
+
 void QQuerySet::setLimit(int count)
 {
     d->setLimit(count);
@@ -603,6 +1706,21 @@ void QQuerySet::setOffset(int val)
     d->setOffset(val);
 }
 
+void QQuerySet::setMaxJoinDepth(int depth)
+{
+    d->setMaxJoinDepth(depth);
+}
+
+void QQuerySet::setRelationLoading(RelationLoading mode)
+{
+    d->setRelationLoading(mode);
+}
+
+void QQuerySet::setTag(const QString &tag)
+{
+    d->setTag(tag);
+}
+
 QString QQuerySet::sql(bool for_remove)
 {
     d->build(for_remove);
@@ -612,8 +1730,17 @@ QString QQuerySet::sql(bool for_remove)
 bool QQuerySet::next()
 {
     d->build(false);
-    d->exec();
-    return d->next();
+
+    bool rs = (d->exec() && d->next());
+
+    d->setIterating(rs);
+
+    return rs;
+}
+
+QQueryPlan QQuerySet::explain()
+{
+    return d->explain();
 }
 
 bool QQuerySet::update(int *affectedRows)
@@ -631,3 +1758,23 @@ void QQuerySet::reset()
 {
     d->reset();
 }
+
+void QQuerySet::foreignKeyLoaded(const QFieldPrivate *field, const QModel *target)
+{
+    QQuerySetPrivate::foreignKeyLoaded(field, target);
+}
+
+bool QQuerySet::execValues(const QVector<QField> &fields)
+{
+    return d->execValues(fields);
+}
+
+bool QQuerySet::nextValues()
+{
+    return d->nextValues();
+}
+
+QVariant QQuerySet::value(int column) const
+{
+    return d->value(column);
+}
@@ -26,6 +26,14 @@
 #include "qfield.h"
 #include "qf.h"
 #include "qforeignkey.h"
+#include "qqueryplan.h"
+
+#include <QVector>
+
+#if defined(__GXX_EXPERIMENTAL_CXX0X__)
+#include <tuple>
+#include <type_traits>
+#endif
 
 class QSqlDatabase;
 
@@ -36,6 +44,14 @@ class QQuerySet
     private:
         Q_DISABLE_COPY(QQuerySet)
 
+    public:
+        enum RelationLoading
+        {
+            LearnRelations,         /*!< @brief Join the foreign keys mostly loaded one by one by the previous iterations of the same query */
+            PinRelations,           /*!< @brief Join the relations learned so far, without learning from this query set */
+            ExplicitRelations       /*!< @brief Only join the relations given with addSelectRelated() */
+        };
+
     public:
         QQuerySet(QModel *model);
         ~QQuerySet();
@@ -46,26 +62,101 @@ class QQuerySet
         void addOrderBy(const QField &field, bool asc);
         void setLimit(int count);
         void setOffset(int val);
+        void setMaxJoinDepth(int depth);        /*!< @brief Foreign keys followed from the model to join a related or filtered table, 4 by default */
+        void setRelationLoading(RelationLoading mode);
+        void setTag(const QString &tag);        /*!< @brief Call site, named by the lazy loading warnings and telling apart the shapes of the query */
 
         // Gestion des champs
         void excludeField(const QField &field);
+        void deferField(const QField &field);   /*!< @brief Don't select the field, load it on first access for all the rows of a window */
         void addField(const QField &field);
         void addFields(QModel *model);
         template<typename T>
         void addFields(const QForeignKey<T> &field);
 
         QString sql(bool for_remove = false);
+        QQueryPlan explain();       /*!< @brief Plan of the SELECT statement, analyzed on PostgreSQL */
         bool next();
         bool update(int *affectedRows = 0);
         void remove();
         void reset();
 
+#if defined(__GXX_EXPERIMENTAL_CXX0X__)
+        template<typename... T, typename... F>
+        QList<std::tuple<T...> > values(const F &...fields);    /*!< @brief Rows of the given fields, decoded without filling the model, empty while next() iterates */
+#endif
+
     private:
+        friend class QForeignKeyPrivate;
+
         QQuerySetPrivate *d;
 
         void addSelectRelated_p(const QField &field);
+        static void foreignKeyLoaded(const QFieldPrivate *field, const QModel *target);
+
+        bool execValues(const QVector<QField> &fields);
+        bool nextValues();
+        QVariant value(int column) const;
+
+#if defined(__GXX_EXPERIMENTAL_CXX0X__)
+        template<int... I> struct Indexes {};
+        template<int N, int... I> struct MakeIndexes : MakeIndexes<N - 1, N - 1, I...> {};
+        template<int... I> struct MakeIndexes<0, I...> { typedef Indexes<I...> Type; };
+
+        template<bool... B> struct AllOf;
+
+        template<typename F, typename T>
+        struct Accepts
+        {
+            typedef typename QFieldTraits<F>::ValueType ValueType;
+            static const bool value = std::is_void<ValueType>::value || std::is_convertible<ValueType, T>::value;
+        };
+
+        template<typename... T, int... I>
+        std::tuple<T...> decodeRow(Indexes<I...>) const
+        {
+            return std::tuple<T...>(qvariant_cast<T>(value(I))...);
+        }
+#endif
+};
+
+#if defined(__GXX_EXPERIMENTAL_CXX0X__)
+template<>
+struct QQuerySet::AllOf<>
+{
+    static const bool value = true;
+};
+
+template<bool B, bool... R>
+struct QQuerySet::AllOf<B, R...>
+{
+    static const bool value = B && AllOf<R...>::value;
 };
 
+template<typename... T, typename... F>
+QList<std::tuple<T...> > QQuerySet::values(const F &...fields)
+{
+    static_assert(sizeof...(T) == sizeof...(F), "values() needs one type per field");
+    static_assert(AllOf<Accepts<F, T>::value...>::value, "values() types must match the types of the fields");
+
+    QList<std::tuple<T...> > rs;
+    QVector<QField> selected;
+
+    selected.reserve(sizeof...(F));
+
+    for (const QField &field : { QField(fields)... })
+        selected.append(field);
+
+    if (!execValues(selected))
+        return rs;
+
+    while (nextValues())
+        rs.append(decodeRow<T...>(typename MakeIndexes<sizeof...(T)>::Type()));
+
+    return rs;
+}
+#endif
+
 template<typename T>
 void QQuerySet::addSelectRelated(const QForeignKey<T> &field)
 {
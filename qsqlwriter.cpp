@@ -0,0 +1,419 @@
+/*
+ * qsqlwriter.cpp
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "qsqlwriter_p.h"
+#include "qfield.h"
+#include "qmodel.h"
+
+#include <QSqlDriver>
+#include <QSqlField>
+#include <QDateTime>
+
+static QString arrayType(const QString &sqlType)
+{
+    // PostgreSQL names of the types used by the fields, empty for the ones
+    // that arrayLiteral() cannot write (BYTEA values would need escaping) or
+    // that are not known to have an array form
+    QString type = sqlType.section(QLatin1Char('('), 0, 0).trimmed().toLower();
+
+    if (type == QLatin1String("integer") ||
+        type == QLatin1String("bigint") ||
+        type == QLatin1String("smallint") ||
+        type == QLatin1String("varchar") ||
+        type == QLatin1String("text") ||
+        type == QLatin1String("boolean") ||
+        type == QLatin1String("date") ||
+        type == QLatin1String("timestamp"))
+        return type;
+    else if (type == QLatin1String("double"))
+        return QLatin1String("double precision");
+    else if (type == QLatin1String("datetime"))
+        return QLatin1String("timestamp");
+
+    return QString();
+}
+
+static QString arrayLiteral(const QVariantList &values)
+{
+    // {1,2,3} or {"a","b"}, parsed by PostgreSQL when cast to the array type
+    QString rs(QLatin1Char('{'));
+
+    for (int i=0; i<values.count(); ++i)
+    {
+        const QVariant &value = values.at(i);
+
+        if (i != 0)
+            rs += QLatin1Char(',');
+
+        if (value.isNull())
+        {
+            rs += QLatin1String("NULL");
+        }
+        else if (value.type() == QVariant::DateTime)
+        {
+            rs += QLatin1Char('"') + value.toDateTime().toString(Qt::ISODate) + QLatin1Char('"');
+        }
+        else
+        {
+            QString str = value.toString();
+
+            str.replace(QLatin1Char('\\'), QLatin1String("\\\\"));
+            str.replace(QLatin1Char('"'), QLatin1String("\\\""));
+            rs += QLatin1Char('"') + str + QLatin1Char('"');
+        }
+    }
+
+    rs += QLatin1Char('}');
+
+    return rs;
+}
+
+static QString jsonArray(const QVariantList &values)
+{
+    // [1,2,3] or ["a","b"], read by the json_each table-valued function of SQLite
+    QString rs(QLatin1Char('['));
+
+    for (int i=0; i<values.count(); ++i)
+    {
+        const QVariant &value = values.at(i);
+
+        if (i != 0)
+            rs += QLatin1Char(',');
+
+        switch (value.type())
+        {
+            case QVariant::Invalid:
+                rs += QLatin1String("null");
+                break;
+            case QVariant::Bool:
+                rs += QLatin1String(value.toBool() ? "1" : "0");
+                break;
+            case QVariant::Int:
+            case QVariant::UInt:
+            case QVariant::LongLong:
+            case QVariant::ULongLong:
+                rs += value.toString();
+                break;
+            case QVariant::Double:
+                rs += QString::number(value.toDouble(), 'g', 17);
+                break;
+            default:
+            {
+                QString str = (value.type() == QVariant::DateTime ?
+                               value.toDateTime().toString(Qt::ISODate) : value.toString());
+
+                rs += QLatin1Char('"');
+
+                for (int j=0; j<str.size(); ++j)
+                {
+                    QChar c = str.at(j);
+
+                    if (c == QLatin1Char('"') || c == QLatin1Char('\\'))
+                        rs += QLatin1Char('\\') + QString(c);
+                    else if (c.unicode() < 0x20)
+                        rs += QString("\\u%1").arg(c.unicode(), 4, 16, QLatin1Char('0'));
+                    else
+                        rs += c;
+                }
+
+                rs += QLatin1Char('"');
+                break;
+            }
+        }
+    }
+
+    rs += QLatin1Char(']');
+
+    return rs;
+}
+
+QSqlWriter::QSqlWriter(QSqlDriver *driver, int reserve)
+: _driver(driver),
+  _alias_policy(TableAliases),
+  _dialect(QtOrmDatabase::Generic),
+  _placeholder_style(PositionalPlaceholders),
+  _models(NULL),
+  _fields(NULL)
+{
+    if (driver)
+    {
+        _sql.reserve(reserve);
+
+        // Use the placeholders the database understands natively, Qt would
+        // have to rewrite the query otherwise
+        if (!driver->hasFeature(QSqlDriver::PositionalPlaceholders) &&
+            driver->hasFeature(QSqlDriver::NamedPlaceholders))
+        {
+            _placeholder_style = NamedPlaceholders;
+        }
+    }
+}
+
+QSqlWriter::~QSqlWriter()
+{
+}
+
+void QSqlWriter::setAliasPolicy(AliasPolicy policy)
+{
+    _alias_policy = policy;
+}
+
+QSqlWriter::AliasPolicy QSqlWriter::aliasPolicy() const
+{
+    return _alias_policy;
+}
+
+void QSqlWriter::setDialect(QtOrmDatabase::Dialect dialect)
+{
+    _dialect = dialect;
+}
+
+QtOrmDatabase::Dialect QSqlWriter::dialect() const
+{
+    return _dialect;
+}
+
+void QSqlWriter::setPlaceholderStyle(PlaceholderStyle style)
+{
+    _placeholder_style = style;
+}
+
+QSqlWriter::PlaceholderStyle QSqlWriter::placeholderStyle() const
+{
+    return _placeholder_style;
+}
+
+void QSqlWriter::collectModels(QSet<QModel *> *models)
+{
+    _models = models;
+}
+
+void QSqlWriter::collectFields(QList<QField> *fields)
+{
+    _fields = fields;
+}
+
+void QSqlWriter::setTemporaryTablePrefix(const QString &prefix)
+{
+    _temporary_table_prefix = prefix;
+}
+
+const QList<QSqlWriter::TemporaryTable> &QSqlWriter::temporaryTables() const
+{
+    return _temporary_tables;
+}
+
+QSqlDriver *QSqlWriter::driver() const
+{
+    return _driver;
+}
+
+const QString &QSqlWriter::sql() const
+{
+    return _sql;
+}
+
+const QVariantList &QSqlWriter::values() const
+{
+    return _values;
+}
+
+int QSqlWriter::size() const
+{
+    return _sql.size();
+}
+
+QSqlWriter &QSqlWriter::operator<<(const QString &str)
+{
+    if (_driver)
+        _sql += str;
+
+    return *this;
+}
+
+QSqlWriter &QSqlWriter::operator<<(const QLatin1String &str)
+{
+    if (_driver)
+        _sql += str;
+
+    return *this;
+}
+
+QSqlWriter &QSqlWriter::operator<<(const char *str)
+{
+    if (_driver)
+        _sql += QLatin1String(str);
+
+    return *this;
+}
+
+QSqlWriter &QSqlWriter::operator<<(QChar c)
+{
+    if (_driver)
+        _sql += c;
+
+    return *this;
+}
+
+QSqlWriter &QSqlWriter::operator<<(char c)
+{
+    if (_driver)
+        _sql += QLatin1Char(c);
+
+    return *this;
+}
+
+QSqlWriter &QSqlWriter::operator<<(int number)
+{
+    if (_driver)
+        _sql += QString::number(number);
+
+    return *this;
+}
+
+void QSqlWriter::appendFieldName(const QField &field)
+{
+    if (_models)
+        _models->insert(field.model());
+
+    if (_fields)
+        _fields->append(field);
+
+    if (!_driver)
+        return;
+
+    if (_alias_policy == TableAliases)
+        _sql += field.escapedFieldName(_driver);
+    else
+        _sql += field.escapedName(_driver);
+}
+
+void QSqlWriter::appendName(const QField &field)
+{
+    if (_models)
+        _models->insert(field.model());
+
+    if (_fields)
+        _fields->append(field);
+
+    if (_driver)
+        _sql += field.escapedName(_driver);
+}
+
+void QSqlWriter::appendTableName(const QModel *model)
+{
+    if (_driver)
+        _sql += model->escapedTableName(_driver);
+}
+
+void QSqlWriter::appendValue(const QVariant &value)
+{
+    if (_placeholder_style == InlineValues)
+    {
+        if (_driver)
+        {
+            QSqlField field(QString(), value.type());
+
+            field.setValue(value);
+            _sql += _driver->formatValue(field);
+        }
+
+        return;
+    }
+
+    if (_driver)
+    {
+        if (_placeholder_style == PositionalPlaceholders)
+        {
+            _sql += QLatin1Char('?');
+        }
+        else
+        {
+            _sql += QLatin1String(":qtorm");
+            _sql += QString::number(_values.count());
+        }
+    }
+
+    _values.append(value);
+}
+
+void QSqlWriter::appendValues(const QVariantList &values)
+{
+    for (int i=0; i<values.count(); ++i)
+    {
+        if (i != 0)
+            *this << ", ";
+
+        appendValue(values.at(i));
+    }
+}
+
+void QSqlWriter::appendIn(const QField &field, const QVariantList &values)
+{
+    int count = values.count();
+    bool large = (count > QtOrmDatabase::maxInlineInValues());
+    QString array_type;
+
+    if (large && _dialect == QtOrmDatabase::PostgreSQL)
+        array_type = arrayType(field.sqlType());
+
+    appendFieldName(field);
+
+    if (!array_type.isEmpty())
+    {
+        // One array bound for the whole list
+        *this << " = ANY(CAST(";
+        appendValue(arrayLiteral(values));
+        *this << " AS " << array_type << "[]))";
+    }
+    else if (large && _dialect == QtOrmDatabase::SQLite)
+    {
+        // One JSON array, expanded in rows by SQLite
+        *this << " IN (SELECT value FROM json_each(";
+        appendValue(jsonArray(values));
+        *this << "))";
+    }
+    else if (count >= QtOrmDatabase::minTemporaryTableInValues() && !_temporary_table_prefix.isEmpty())
+    {
+        // Too many values for the statement, they are loaded in a temporary
+        // table before it is run
+        TemporaryTable table;
+
+        table.name = _temporary_table_prefix + QString::number(_temporary_tables.count());
+        table.type = field.sqlType();
+        table.values = values;
+        _temporary_tables.append(table);
+
+        *this << " IN (SELECT v FROM ";
+
+        if (_driver)
+            _sql += _driver->escapeIdentifier(table.name, QSqlDriver::TableName);
+
+        *this << ')';
+    }
+    else
+    {
+        *this << " IN (";
+        appendValues(values);
+        *this << ')';
+    }
+}
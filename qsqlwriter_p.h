@@ -0,0 +1,115 @@
+/*
+ * qsqlwriter_p.h
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef __QSQLWRITER_P_H__
+#define __QSQLWRITER_P_H__
+
+#include <QString>
+#include <QVariant>
+#include <QSet>
+
+#include "qtormdatabase.h"
+
+class QSqlDriver;
+class QField;
+class QModel;
+
+/*
+ * Accumulates the text and the bind values of a statement in one buffer. A
+ * writer without driver only collects the bind values.
+ *
+ * The rendering context tells how fields are named (with the T0, T1, etc
+ * table aliases of a SELECT, or bare for the single table of an UPDATE or a
+ * DELETE), which SQL dialect is written and which placeholders are used.
+ */
+class QSqlWriter
+{
+    public:
+        enum AliasPolicy
+        {
+            TableAliases,
+            NoAliases
+        };
+
+        enum PlaceholderStyle
+        {
+            PositionalPlaceholders,     /*!< @brief ? */
+            NamedPlaceholders,          /*!< @brief :qtorm0, :qtorm1, etc */
+            InlineValues                /*!< @brief Literals formatted by the driver, for statements without bind values */
+        };
+
+        struct TemporaryTable
+        {
+            QString name;
+            QString type;
+            QVariantList values;
+        };
+
+    public:
+        QSqlWriter(QSqlDriver *driver, int reserve = 256);
+        ~QSqlWriter();
+
+        void setAliasPolicy(AliasPolicy policy);
+        AliasPolicy aliasPolicy() const;
+        void setDialect(QtOrmDatabase::Dialect dialect);
+        QtOrmDatabase::Dialect dialect() const;
+        void setPlaceholderStyle(PlaceholderStyle style);
+        PlaceholderStyle placeholderStyle() const;
+        void collectModels(QSet<QModel *> *models);
+        void collectFields(QList<QField> *fields);
+        void setTemporaryTablePrefix(const QString &prefix);   /*!< @brief Allows large IN lists to be loaded in temporary tables */
+        const QList<TemporaryTable> &temporaryTables() const;
+
+        QSqlDriver *driver() const;
+        const QString &sql() const;
+        const QVariantList &values() const;
+        int size() const;
+
+        QSqlWriter &operator<<(const QString &str);
+        QSqlWriter &operator<<(const QLatin1String &str);
+        QSqlWriter &operator<<(const char *str);
+        QSqlWriter &operator<<(QChar c);
+        QSqlWriter &operator<<(char c);
+        QSqlWriter &operator<<(int number);
+
+        void appendFieldName(const QField &field);  /*!< @brief Field name, qualified by its table alias if the policy allows it */
+        void appendName(const QField &field);       /*!< @brief Field name without table */
+        void appendTableName(const QModel *model);
+        void appendValue(const QVariant &value);
+        void appendValues(const QVariantList &values);
+        void appendIn(const QField &field, const QVariantList &values);
+
+    private:
+        QSqlDriver *_driver;
+        QString _sql;
+        QVariantList _values;
+
+        AliasPolicy _alias_policy;
+        QtOrmDatabase::Dialect _dialect;
+        PlaceholderStyle _placeholder_style;
+        QSet<QModel *> *_models;
+        QList<QField> *_fields;
+        QString _temporary_table_prefix;
+        QList<TemporaryTable> _temporary_tables;
+};
+
+#endif
@@ -31,20 +31,21 @@ class QStringFieldPrivate : public QFieldPrivate
 
         void setMaxLength(unsigned int length);
         void setValue(const QString &value);
+        QString value() const;
 
         void fromData(const QVariant &data);
         QVariant data() const;
+        QString sqlType() const;
         QString sqlDescription() const;
 
     private:
-        QString _data;
         unsigned int _max_length;
 };
 
 QStringFieldPrivate::QStringFieldPrivate(QModel *model, const QString &name)
  : QFieldPrivate(model, name), _max_length(200)
 {
-
+    allocateValue<QString>(QString());
 }
 
 QStringFieldPrivate::~QStringFieldPrivate()
@@ -61,14 +62,24 @@ void QStringFieldPrivate::setValue(const QString &value)
 {
     setNull(false); // The field is not null anymore
     setModified(true);
-    _data = value;
+    rowValue<QString>() = value;
+}
+
+QString QStringFieldPrivate::value() const
+{
+    ensureLoaded();
+
+    if (isNull())
+        return QString();
+
+    return rowValue<QString>();
 }
 
 void QStringFieldPrivate::fromData(const QVariant &data)
 {
     setNull(data.isNull());
     setModified(false);
-    _data = data.toString();
+    rowValue<QString>() = data.toString();
 }
 
 QVariant QStringFieldPrivate::data() const
@@ -76,12 +87,17 @@ QVariant QStringFieldPrivate::data() const
     if (isNull())
         return QVariant();
     else
-        return QVariant(_data);
+        return QVariant(rowValue<QString>());
+}
+
+QString QStringFieldPrivate::sqlType() const
+{
+    return QString("VARCHAR(%1)").arg(_max_length);
 }
 
 QString QStringFieldPrivate::sqlDescription() const
 {
-    QString rs = QString("VARCHAR(%1)").arg(_max_length);
+    QString rs = sqlType();
 
     rs += commonSqlDescription();
 
@@ -98,7 +114,7 @@ QStringField::QStringField()
 }
 
 QStringField::QStringField(QModel *model, const QString &name)
- : QField(new QStringFieldPrivate(model, name))
+ : QField(new (model) QStringFieldPrivate(model, name))
 {
 }
 
@@ -108,7 +124,17 @@ QStringField::~QStringField()
 
 QStringField::operator QString() const
 {
-    return dptr()->data().toString();
+    return dptr()->value();
+}
+
+QString QStringField::value() const
+{
+    return dptr()->value();
+}
+
+void QStringField::setValue(const QString &value)
+{
+    dptr()->setValue(value);
 }
 
 void QStringField::setMaxLength(unsigned int length)
@@ -37,6 +37,8 @@ class QStringField : public QField
         void setMaxLength(unsigned int length);
 
         operator QString() const;
+        QString value() const;    /*!< @brief Value of the field, read without QVariant */
+        void setValue(const QString &value);
         QStringField &operator=(const QString &value);
 
         _Q_F_ASSIGN(QStringField)
@@ -47,4 +49,10 @@ class QStringField : public QField
 
 Q_DECLARE_TYPEINFO(QStringField, Q_MOVABLE_TYPE);
 
+template<>
+struct QFieldTraits<QStringField>
+{
+    typedef QString ValueType;
+};
+
 #endif
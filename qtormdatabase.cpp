@@ -1,7 +1,20 @@
 #include "qtormdatabase.h"
+#include "qtorminstrumentation.h"
+#include "qqueryplan.h"
+
+#include <QSqlQuery>
+#include <QSqlDriver>
+#include <QElapsedTimer>
 
 static bool per_thread_database = false;
 static QtOrmDatabase::CreatorFunc creator_func = NULL;
+static int max_inline_in_values = 100;
+static int min_temporary_table_in_values = 1000;
+static int slow_query_threshold = 0;
+static int lazy_load_threshold = 0;
+static int lazy_load_sampling = 1;
+static bool relation_learning = false;
+static bool adaptive_projection = false;
 
 __thread QSqlDatabase *thread_database = NULL;
 
@@ -11,8 +24,16 @@ QSqlDatabase QtOrmDatabase::threadDatabase()
     if (per_thread_database)
     {
         if (!thread_database)
+        {
+            bool instrumented = QtOrmInstrumentation::isEnabled();
+            qint64 start = (instrumented ? QtOrmInstrumentation::timestamp() : 0);
+
             thread_database = new QSqlDatabase(creator_func());
 
+            if (instrumented)
+                QtOrmInstrumentation::record(QtOrmInstrumentation::Checkout, QtOrmInstrumentation::Select, QString(), QString(), start);
+        }
+
         return *thread_database;
     }
     else
@@ -43,3 +64,137 @@ void QtOrmDatabase::setDatabaseCreator(QtOrmDatabase::CreatorFunc func)
 {
     creator_func = func;
 }
+
+QtOrmDatabase::Dialect QtOrmDatabase::dialect(const QSqlDatabase &db)
+{
+    QString name = db.driverName();
+
+    if (name.startsWith(QLatin1String("QSQLITE")))
+        return SQLite;
+    else if (name.startsWith(QLatin1String("QPSQL")))
+        return PostgreSQL;
+    else if (name.startsWith(QLatin1String("QMYSQL")))
+        return MySQL;
+    else
+        return Generic;
+}
+
+const char *QtOrmDatabase::driverType(const QSqlDriver *driver)
+{
+    // The drivers of a class escape the same way. Unlike their address, that
+    // a driver allocated after the removal of a database can reuse.
+    return driver->metaObject()->className();
+}
+
+int QtOrmDatabase::maxBindValues(const QSqlDatabase &db)
+{
+    // SQLite is compiled with SQLITE_MAX_VARIABLE_NUMBER = 999 by default, the
+    // PostgreSQL protocol stores the parameter count in a 16-bit integer.
+    if (dialect(db) == PostgreSQL)
+        return 32767;
+    else
+        return 999;
+}
+
+void QtOrmDatabase::setMaxInlineInValues(int count)
+{
+    max_inline_in_values = count;
+}
+
+int QtOrmDatabase::maxInlineInValues()
+{
+    return max_inline_in_values;
+}
+
+void QtOrmDatabase::setMinTemporaryTableInValues(int count)
+{
+    min_temporary_table_in_values = count;
+}
+
+int QtOrmDatabase::minTemporaryTableInValues()
+{
+    return min_temporary_table_in_values;
+}
+
+void QtOrmDatabase::setSlowQueryThreshold(int msecs)
+{
+    slow_query_threshold = msecs;
+}
+
+int QtOrmDatabase::slowQueryThreshold()
+{
+    return slow_query_threshold;
+}
+
+bool QtOrmDatabase::exec(const QSqlDatabase &db, QSqlQuery &query, const QString &sql, const QVariantList &values,
+                         QtOrmInstrumentation::StatementKind kind, const QString &table, qint64 *usecs)
+{
+    int threshold = slow_query_threshold;
+    bool instrumented = QtOrmInstrumentation::isEnabled();
+
+    if (threshold <= 0 && !instrumented && !usecs)
+        return query.exec();
+
+    QElapsedTimer timer;
+    qint64 start = (instrumented ? QtOrmInstrumentation::timestamp() : 0);
+
+    timer.start();
+
+    bool rs = query.exec();
+    qint64 elapsed = timer.nsecsElapsed() / 1000;
+
+    if (instrumented)
+    {
+        int rows = (kind == QtOrmInstrumentation::Select ? query.size() : query.numRowsAffected());
+
+        QtOrmInstrumentation::record(QtOrmInstrumentation::Execute, kind, table, sql, start, rows);
+    }
+
+    if (threshold > 0 && elapsed >= qint64(threshold) * 1000)
+        QQueryPlan::logSlowQuery(db, sql, values, elapsed);
+
+    if (usecs)
+        *usecs = elapsed;
+
+    return rs;
+}
+
+void QtOrmDatabase::setLazyLoadThreshold(int queries)
+{
+    lazy_load_threshold = queries;
+}
+
+int QtOrmDatabase::lazyLoadThreshold()
+{
+    return lazy_load_threshold;
+}
+
+void QtOrmDatabase::setLazyLoadSampling(int iterations)
+{
+    lazy_load_sampling = qMax(iterations, 1);
+}
+
+int QtOrmDatabase::lazyLoadSampling()
+{
+    return lazy_load_sampling;
+}
+
+void QtOrmDatabase::setRelationLearning(bool enable)
+{
+    relation_learning = enable;
+}
+
+bool QtOrmDatabase::relationLearning()
+{
+    return relation_learning;
+}
+
+void QtOrmDatabase::setAdaptiveProjection(bool enable)
+{
+    adaptive_projection = enable;
+}
+
+bool QtOrmDatabase::adaptiveProjection()
+{
+    return adaptive_projection;
+}
@@ -2,10 +2,24 @@
 #define __QTORMDATABASE_H__
 
 #include <QSqlDatabase>
+#include <QVariant>
+
+#include "qtorminstrumentation.h"
+
+class QSqlQuery;
+class QSqlDriver;
 
 class QtOrmDatabase
 {
     public:
+        enum Dialect
+        {
+            Generic,
+            SQLite,
+            PostgreSQL,
+            MySQL
+        };
+
         static QSqlDatabase threadDatabase();
 
         typedef QSqlDatabase (*CreatorFunc)();
@@ -14,6 +28,32 @@ class QtOrmDatabase
         static bool threadHasDatabase();
         static void setThreadDatabase(QSqlDatabase db);
         static void setDatabaseCreator(CreatorFunc func);
+
+        static Dialect dialect(const QSqlDatabase &db);
+        static const char *driverType(const QSqlDriver *driver);   /*!< @brief Class of the driver, keys what depends on its escaping */
+        static int maxBindValues(const QSqlDatabase &db);
+
+        // Strategies of IN filters
+        static void setMaxInlineInValues(int count);        /*!< @brief Above, lists are bound as one array where supported */
+        static int maxInlineInValues();
+        static void setMinTemporaryTableInValues(int count); /*!< @brief From, lists are loaded in a temporary table elsewhere */
+        static int minTemporaryTableInValues();
+
+        static void setSlowQueryThreshold(int msecs);      /*!< @brief Log the statements running longer, with their plan. 0 disables it */
+        static int slowQueryThreshold();
+
+        // Run a prepared query, reported to the instrumentation and logged if slow. usecs receives its duration
+        static bool exec(const QSqlDatabase &db, QSqlQuery &query, const QString &sql, const QVariantList &values,
+                         QtOrmInstrumentation::StatementKind kind, const QString &table, qint64 *usecs = NULL);
+
+        static void setLazyLoadThreshold(int queries);     /*!< @brief Warn when iterating a query set loads more foreign keys one by one. 0 disables it */
+        static int lazyLoadThreshold();
+        static void setLazyLoadSampling(int iterations);   /*!< @brief Watch one iteration of a query set out of this count, 1 watches them all */
+        static int lazyLoadSampling();
+        static void setRelationLearning(bool enable);      /*!< @brief Join the foreign keys that previous iterations of a query loaded one by one. Off by default */
+        static bool relationLearning();
+        static void setAdaptiveProjection(bool enable);    /*!< @brief Select the fields read by the first iterations of a query, load the others on demand */
+        static bool adaptiveProjection();
 };
 
 #endif
\ No newline at end of file
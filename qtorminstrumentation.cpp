@@ -0,0 +1,326 @@
+/*
+ * qtorminstrumentation.cpp
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "qtorminstrumentation.h"
+
+#include <QElapsedTimer>
+#include <QSet>
+#include <QThread>
+#include <QtDebug>
+
+#if defined(Q_OS_UNIX)
+#include <time.h>
+#endif
+
+QAtomicInt QtOrmInstrumentation::_installed_count(0);
+
+struct InstalledList
+{
+    int count;
+    QtOrmInstrumentation *instrumentations[QtOrmInstrumentation::MaxInstalled];
+};
+
+/*
+ * record() reads the list without lock. install() and uninstall() publish a
+ * copy, then flip the epoch and wait for the calls counted in the previous
+ * one before deleting the old list. Static, statements may run from globals.
+ */
+static QBasicAtomicPointer<InstalledList> installed = Q_BASIC_ATOMIC_INITIALIZER(0);
+static QBasicAtomicInt installed_epoch = Q_BASIC_ATOMIC_INITIALIZER(0);
+static QBasicAtomicInt installed_readers[2] = {Q_BASIC_ATOMIC_INITIALIZER(0), Q_BASIC_ATOMIC_INITIALIZER(0)};
+static QMutex installed_mutex;
+
+/*
+ * The timestamps are nanoseconds since the first install(). On Unix, they are
+ * read from CLOCK_MONOTONIC, the clock of the other traces of the system, and
+ * its origin is exact. QElapsedTimer only gives its origin in milliseconds.
+ */
+#if defined(Q_OS_UNIX)
+static qint64 clock_origin = 0;
+
+static inline qint64 monotonicClock()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return qint64(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+#else
+static QElapsedTimer instrumentation_clock;
+#endif
+
+static void publishInstalled(InstalledList *list)
+{
+    InstalledList *old = installed.fetchAndStoreOrdered(list);
+    int epoch = installed_epoch;
+
+    installed_epoch.fetchAndStoreOrdered(epoch + 1);
+
+    // Calls that loaded the old list counted themselves in the previous epoch
+    while (installed_readers[epoch & 1] != 0)
+        QThread::yieldCurrentThread();
+
+    delete old;
+}
+
+static const char *phase_names[] = {"build", "prepare", "execute", "fetch", "decode", "fill cache", "checkout", "call"};
+
+/*
+ * QtOrmInstrumentation
+ */
+
+QtOrmInstrumentation::~QtOrmInstrumentation()
+{
+}
+
+bool QtOrmInstrumentation::install(QtOrmInstrumentation *instrumentation)
+{
+    if (!instrumentation)
+    {
+        qDebug() << "Cannot install a NULL instrumentation, use uninstall() to disable one";
+        return false;
+    }
+
+    QMutexLocker locker(&installed_mutex);
+    InstalledList *list = installed;
+    int count = (list ? list->count : 0);
+
+#if defined(Q_OS_UNIX)
+    if (!clock_origin)
+        clock_origin = monotonicClock();
+#else
+    if (!instrumentation_clock.isValid())
+        instrumentation_clock.start();
+#endif
+
+    for (int i=0; i<count; ++i)
+    {
+        if (list->instrumentations[i] == instrumentation)
+            return true;
+    }
+
+    if (count == MaxInstalled)
+        return false;
+
+    InstalledList *copy = new InstalledList;
+
+    for (int i=0; i<count; ++i)
+        copy->instrumentations[i] = list->instrumentations[i];
+
+    copy->instrumentations[count] = instrumentation;
+    copy->count = count + 1;
+
+    publishInstalled(copy);
+    _installed_count.ref();
+
+    return true;
+}
+
+void QtOrmInstrumentation::uninstall(QtOrmInstrumentation *instrumentation)
+{
+    QMutexLocker locker(&installed_mutex);
+    InstalledList *list = installed;
+    int count = (list ? list->count : 0);
+
+    for (int i=0; i<count; ++i)
+    {
+        if (list->instrumentations[i] != instrumentation)
+            continue;
+
+        InstalledList *copy = new InstalledList;
+
+        copy->count = 0;
+
+        for (int j=0; j<count; ++j)
+        {
+            if (j != i)
+                copy->instrumentations[copy->count++] = list->instrumentations[j];
+        }
+
+        _installed_count.deref();
+
+        // Waits for the events being recorded by other threads
+        publishInstalled(copy);
+        break;
+    }
+}
+
+qint64 QtOrmInstrumentation::timestamp()
+{
+#if defined(Q_OS_UNIX)
+    return monotonicClock() - clock_origin;
+#else
+    return instrumentation_clock.nsecsElapsed();
+#endif
+}
+
+qint64 QtOrmInstrumentation::clockOrigin()
+{
+#if defined(Q_OS_UNIX)
+    return clock_origin;
+#else
+    return instrumentation_clock.msecsSinceReference() * 1000000LL;
+#endif
+}
+
+const char *QtOrmInstrumentation::phaseName(Phase phase)
+{
+    return phase_names[phase];
+}
+
+void QtOrmInstrumentation::record(Phase phase, StatementKind kind, const QString &table, const QString &shape,
+                                  qint64 start, int rows, qint64 bytes)
+{
+    Event event;
+
+    event.phase = phase;
+    event.kind = kind;
+    event.table = table;
+    event.shape = shape;
+    event.start = start;
+    event.end = timestamp();
+    event.rows = rows;
+    event.bytes = bytes;
+
+    int epoch;
+
+    // Count this call in the epoch that is still current once counted
+    for (;;)
+    {
+        epoch = installed_epoch;
+        installed_readers[epoch & 1].ref();
+
+        if (installed_epoch == epoch)
+            break;
+
+        installed_readers[epoch & 1].deref();
+    }
+
+    const InstalledList *list = installed;
+
+    for (int i=0; list && i<list->count; ++i)
+        list->instrumentations[i]->event(event);
+
+    installed_readers[epoch & 1].deref();
+}
+
+/*
+ * QtOrmHistograms
+ */
+
+QtOrmHistograms::Histogram::Histogram()
+ : count(0), total(0), max(0), rows(0), bytes(0)
+{
+    for (int i=0; i<Buckets; ++i)
+        buckets[i] = 0;
+}
+
+QtOrmHistograms::QtOrmHistograms()
+{
+}
+
+QtOrmHistograms::~QtOrmHistograms()
+{
+}
+
+void QtOrmHistograms::event(const Event &event)
+{
+    qint64 duration = event.end - event.start;
+    qint64 usecs = duration / 1000;
+    int bucket = 0;
+
+    while (usecs > 1 && bucket < Buckets - 1)
+    {
+        usecs >>= 1;
+        ++bucket;
+    }
+
+    QMutexLocker locker(&_mutex);
+    Histogram &histogram = _histograms[qMakePair(int(event.phase), event.shape)];
+
+    histogram.count++;
+    histogram.total += duration;
+    histogram.max = qMax(histogram.max, duration);
+    histogram.buckets[bucket]++;
+
+    if (event.rows > 0)
+        histogram.rows += event.rows;
+
+    histogram.bytes += event.bytes;
+}
+
+QStringList QtOrmHistograms::shapes() const
+{
+    QMutexLocker locker(&_mutex);
+    QSet<QString> rs;
+
+    for (QHash<QPair<int, QString>, Histogram>::const_iterator it = _histograms.constBegin(); it != _histograms.constEnd(); ++it)
+        rs.insert(it.key().second);
+
+    return rs.toList();
+}
+
+QtOrmHistograms::Histogram QtOrmHistograms::histogram(const QString &shape, Phase phase) const
+{
+    QMutexLocker locker(&_mutex);
+
+    return _histograms.value(qMakePair(int(phase), shape));
+}
+
+QString QtOrmHistograms::report() const
+{
+    QStringList shape_list = shapes();
+    QString rs;
+
+    shape_list.sort();
+
+    for (int i=0; i<shape_list.count(); ++i)
+    {
+        rs += shape_list.at(i) + QLatin1Char('\n');
+
+        for (int phase=Build; phase<=Call; ++phase)
+        {
+            Histogram h = histogram(shape_list.at(i), (Phase)phase);
+
+            if (h.count == 0)
+                continue;
+
+            rs += QString("    %1: %2 times, mean %3 us, max %4 us, %5 rows, %6 bytes\n")
+                .arg(QLatin1String(phaseName((Phase)phase)))
+                .arg(h.count)
+                .arg(h.total / h.count / 1000)
+                .arg(h.max / 1000)
+                .arg(h.rows)
+                .arg(h.bytes);
+        }
+    }
+
+    return rs;
+}
+
+void QtOrmHistograms::clear()
+{
+    QMutexLocker locker(&_mutex);
+
+    _histograms.clear();
+}
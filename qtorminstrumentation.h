@@ -0,0 +1,145 @@
+/*
+ * qtorminstrumentation.h
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef __QTORMINSTRUMENTATION_H__
+#define __QTORMINSTRUMENTATION_H__
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QPair>
+#include <QMutex>
+#include <QAtomicInt>
+
+/*
+ * Receives the timings of every phase of the statements run by QtORM. Up to
+ * MaxInstalled instrumentations are installed at a time; when none is
+ * installed, the ORM doesn't even read the clock.
+ *
+ * event() is called by the thread running the statement, without lock.
+ * uninstall() waits for the calls in progress, the instrumentation can be
+ * deleted once it returns. event() must not install nor uninstall.
+ */
+class QtOrmInstrumentation
+{
+    public:
+        enum Phase
+        {
+            Build,          /*!< @brief Generation of the SQL */
+            Prepare,        /*!< @brief QSqlQuery::prepare() */
+            Execute,        /*!< @brief QSqlQuery::exec() */
+            Fetch,          /*!< @brief QSqlQuery::next(), one row */
+            Decode,         /*!< @brief Values of one row copied into the fields */
+            FillCache,      /*!< @brief Target of a foreign key loaded on access, its statement included */
+            Checkout,       /*!< @brief Database of the thread opened, without kind, table nor shape */
+            Call            /*!< @brief Whole QModel::save(), saveBatch() or remove(), the shape is the method */
+        };
+
+        enum StatementKind
+        {
+            Select,
+            Insert,
+            Update,
+            Delete
+        };
+
+        struct Event
+        {
+            Phase phase;
+            StatementKind kind;
+            QString table;
+            QString shape;      /*!< @brief SQL with placeholders, identifies the query whatever its values */
+            qint64 start;       /*!< @brief Monotonic time, in nanoseconds */
+            qint64 end;
+            int rows;           /*!< @brief Rows fetched or written, -1 if not known */
+            qint64 bytes;       /*!< @brief Size of the decoded values */
+        };
+
+    public:
+        virtual ~QtOrmInstrumentation();
+
+        virtual void event(const Event &event) = 0;
+
+        enum
+        {
+            MaxInstalled = 8
+        };
+
+        static bool install(QtOrmInstrumentation *instrumentation);    /*!< @brief Not owned, false if NULL or too many are installed */
+        static void uninstall(QtOrmInstrumentation *instrumentation);
+
+        static inline bool isEnabled()
+        {
+            return (_installed_count != 0);
+        }
+
+        static qint64 timestamp();
+        static qint64 clockOrigin();    /*!< @brief Monotonic clock of the system at timestamp() 0, in nanoseconds */
+        static const char *phaseName(Phase phase);
+        static void record(Phase phase, StatementKind kind, const QString &table, const QString &shape,
+                           qint64 start, int rows = -1, qint64 bytes = 0);
+
+    private:
+        static QAtomicInt _installed_count;     // Read without lock, only to skip the clock
+};
+
+/*
+ * Built-in instrumentation keeping a histogram of the durations of every
+ * phase of every query shape.
+ */
+class QtOrmHistograms : public QtOrmInstrumentation
+{
+    public:
+        enum
+        {
+            Buckets = 32    /*!< @brief Bucket i counts the durations from 2^i to 2^(i+1) microseconds */
+        };
+
+        struct Histogram
+        {
+            Histogram();
+
+            qint64 count;
+            qint64 total;   /*!< @brief Nanoseconds */
+            qint64 max;
+            qint64 rows;
+            qint64 bytes;
+            qint64 buckets[Buckets];
+        };
+
+    public:
+        QtOrmHistograms();
+        ~QtOrmHistograms();
+
+        void event(const Event &event);
+
+        QStringList shapes() const;
+        Histogram histogram(const QString &shape, Phase phase) const;
+        QString report() const;
+        void clear();
+
+    private:
+        mutable QMutex _mutex;
+        QHash<QPair<int, QString>, Histogram> _histograms;  // Keyed by phase and shape
+};
+
+#endif
@@ -0,0 +1,408 @@
+/*
+ * qtormmetrics.cpp
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "qtormmetrics.h"
+
+#include <QIODevice>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QList>
+#include <QThreadStorage>
+
+#include <string.h>
+
+// Bounds of the buckets, in nanoseconds for the durations
+static const qint64 duration_bounds[] = {
+    100000LL, 250000LL, 500000LL, 1000000LL, 2500000LL, 5000000LL, 10000000LL, 25000000LL,
+    50000000LL, 100000000LL, 250000000LL, 500000000LL, 1000000000LL, 2500000000LL, 5000000000LL, 10000000000LL
+};
+static const qint64 size_bounds[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000};
+
+enum
+{
+    DurationBuckets = sizeof(duration_bounds) / sizeof(qint64),
+    SizeBuckets = sizeof(size_bounds) / sizeof(qint64)
+};
+
+static const char *kind_names[] = {"select", "insert", "update", "delete"};
+
+static inline void atomicAdd(qint64 *counter, qint64 value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline qint64 atomicLoad(const qint64 *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+template<int N>
+struct Histogram
+{
+    qint64 buckets[N + 1];      // The last one is +Inf
+    qint64 sum;
+    qint64 count;
+
+    void observe(const qint64 *bounds, qint64 value)
+    {
+        int bucket = 0;
+
+        while (bucket < N && value > bounds[bucket])
+            ++bucket;
+
+        atomicAdd(&buckets[bucket], 1);
+        atomicAdd(&sum, value);
+        atomicAdd(&count, 1);
+    }
+
+    void merge(const Histogram<N> &other)
+    {
+        for (int i=0; i<=N; ++i)
+            buckets[i] += atomicLoad(&other.buckets[i]);
+
+        sum += atomicLoad(&other.sum);
+        count += atomicLoad(&other.count);
+    }
+};
+
+struct TableMetrics
+{
+    TableMetrics()
+    {
+        memset(this, 0, sizeof(TableMetrics));
+    }
+
+    void merge(const TableMetrics &other)
+    {
+        for (int i=0; i<4; ++i)
+        {
+            queries[i] += atomicLoad(&other.queries[i]);
+            durations[i].merge(other.durations[i]);
+        }
+
+        rows_read += atomicLoad(&other.rows_read);
+        rows_written += atomicLoad(&other.rows_written);
+        fill_cache += atomicLoad(&other.fill_cache);
+        batch_sizes.merge(other.batch_sizes);
+    }
+
+    qint64 queries[4];                          // By statement kind
+    Histogram<DurationBuckets> durations[4];
+    qint64 rows_read, rows_written;
+    qint64 fill_cache;
+    Histogram<SizeBuckets> batch_sizes;         // Rows inserted by a statement
+};
+
+struct ThreadMetrics
+{
+    ThreadMetrics()
+    {
+        memset(&checkouts, 0, sizeof(checkouts));
+    }
+
+    ~ThreadMetrics()
+    {
+        qDeleteAll(tables);
+    }
+
+    void merge(const ThreadMetrics &other)
+    {
+        for (QHash<QString, TableMetrics *>::const_iterator it = other.tables.constBegin();
+             it != other.tables.constEnd(); ++it)
+        {
+            TableMetrics *&table = tables[it.key()];
+
+            if (!table)
+                table = new TableMetrics;
+
+            table->merge(*it.value());
+        }
+
+        checkouts.merge(other.checkouts);
+    }
+
+    QMutex mutex;       // Held to add a table, and to merge
+    QHash<QString, TableMetrics *> tables;
+    Histogram<DurationBuckets> checkouts;
+};
+
+// Held while merging, so that an exiting thread cannot free its block meanwhile
+static QMutex threads_mutex;
+static QList<ThreadMetrics *> threads;
+static ThreadMetrics retired;       // Counts of the threads that exited
+static __thread ThreadMetrics *thread_metrics = NULL;
+static __thread bool thread_exited = false;
+
+struct ThreadExitHook
+{
+    ~ThreadExitHook()
+    {
+        if (thread_metrics)
+        {
+            QMutexLocker locker(&threads_mutex);
+
+            threads.removeOne(thread_metrics);
+            retired.merge(*thread_metrics);
+        }
+
+        delete thread_metrics;
+        thread_metrics = NULL;
+        thread_exited = true;
+    }
+};
+
+static QThreadStorage<ThreadExitHook *> exit_hooks;
+
+static ThreadMetrics *currentThreadMetrics()
+{
+    if (!thread_metrics)
+    {
+        thread_metrics = new ThreadMetrics;
+
+        // Statements run by the destructors of other thread storages count in a block kept alive
+        if (!thread_exited)
+            exit_hooks.setLocalData(new ThreadExitHook);
+
+        QMutexLocker locker(&threads_mutex);
+        threads.append(thread_metrics);
+    }
+
+    return thread_metrics;
+}
+
+static TableMetrics *tableMetrics(ThreadMetrics *thread, const QString &table)
+{
+    // Only the thread itself adds tables, it reads them without lock
+    TableMetrics *rs = thread->tables.value(table);
+
+    if (!rs)
+    {
+        rs = new TableMetrics;
+
+        QMutexLocker locker(&thread->mutex);
+        thread->tables.insert(table, rs);
+    }
+
+    return rs;
+}
+
+/*
+ * Prometheus text format
+ */
+
+static QString escapeLabel(const QString &value)
+{
+    QString rs = value;
+
+    rs.replace(QLatin1Char('\\'), QLatin1String("\\\\"));
+    rs.replace(QLatin1Char('"'), QLatin1String("\\\""));
+    rs.replace(QLatin1Char('\n'), QLatin1String("\\n"));
+
+    return rs;
+}
+
+static void writeHeader(QString &rs, const char *name, const char *type, const char *help)
+{
+    rs += QString("# HELP %1 %2\n# TYPE %1 %3\n").arg(QLatin1String(name), QLatin1String(help), QLatin1String(type));
+}
+
+static void writeSample(QString &rs, const QString &name, const QString &labels, const QString &value)
+{
+    rs += name;
+
+    if (!labels.isEmpty())
+        rs += QLatin1Char('{') + labels + QLatin1Char('}');
+
+    rs += QLatin1Char(' ') + value + QLatin1Char('\n');
+}
+
+template<int N>
+static void writeHistogram(QString &rs, const char *name, const QString &labels, const Histogram<N> &histogram,
+                           const qint64 *bounds, double scale)
+{
+    QString base = QLatin1String(name);
+    QString prefix = (labels.isEmpty() ? QString() : labels + QLatin1Char(','));
+    qint64 cumulated = 0;
+
+    for (int i=0; i<=N; ++i)
+    {
+        QString le = (i == N ? QString("+Inf") : QString::number(bounds[i] * scale));
+
+        cumulated += histogram.buckets[i];
+        writeSample(rs, base + QLatin1String("_bucket"), prefix + QString("le=\"%1\"").arg(le),
+                    QString::number(cumulated));
+    }
+
+    writeSample(rs, base + QLatin1String("_sum"), labels, QString::number(histogram.sum * scale));
+    writeSample(rs, base + QLatin1String("_count"), labels, QString::number(histogram.count));
+}
+
+/*
+ * QtOrmMetrics
+ */
+
+QtOrmMetrics::QtOrmMetrics()
+{
+}
+
+QtOrmMetrics::~QtOrmMetrics()
+{
+    // global() is destroyed at exit, statements may still run from other threads
+    uninstall(this);
+}
+
+QtOrmMetrics *QtOrmMetrics::global()
+{
+    static QtOrmMetrics metrics;
+
+    return &metrics;
+}
+
+void QtOrmMetrics::event(const Event &event)
+{
+    ThreadMetrics *thread = currentThreadMetrics();
+    qint64 duration = event.end - event.start;
+
+    switch (event.phase)
+    {
+        case Execute:
+        {
+            TableMetrics *table = tableMetrics(thread, event.table);
+
+            atomicAdd(&table->queries[event.kind], 1);
+            table->durations[event.kind].observe(duration_bounds, duration);
+
+            if (event.kind != Select && event.rows > 0)
+                atomicAdd(&table->rows_written, event.rows);
+
+            if (event.kind == Insert && event.rows > 0)
+                table->batch_sizes.observe(size_bounds, event.rows);
+            break;
+        }
+        case Fetch:
+            if (event.rows > 0)
+                atomicAdd(&tableMetrics(thread, event.table)->rows_read, event.rows);
+            break;
+        case FillCache:
+            atomicAdd(&tableMetrics(thread, event.table)->fill_cache, 1);
+            break;
+        case Checkout:
+            thread->checkouts.observe(duration_bounds, duration);
+            break;
+        default:
+            break;
+    }
+}
+
+bool QtOrmMetrics::write(QIODevice *device) const
+{
+    QMap<QString, TableMetrics> tables;
+    Histogram<DurationBuckets> checkouts;
+
+    // Merge the blocks of all the threads, and of those that exited
+    ThreadMetrics merged;
+    QMutexLocker threads_locker(&threads_mutex);
+
+    merged.merge(retired);
+
+    for (int i=0; i<threads.count(); ++i)
+    {
+        ThreadMetrics *thread = threads.at(i);
+        QMutexLocker locker(&thread->mutex);
+
+        merged.merge(*thread);
+    }
+
+    threads_locker.unlock();
+
+    for (QHash<QString, TableMetrics *>::const_iterator it = merged.tables.constBegin();
+         it != merged.tables.constEnd(); ++it)
+    {
+        tables.insert(it.key(), *it.value());
+    }
+
+    checkouts = merged.checkouts;
+
+    QString rs;
+    const double seconds = 1e-9;
+
+    writeHeader(rs, "qtorm_queries_total", "counter", "Statements executed");
+
+    for (QMap<QString, TableMetrics>::const_iterator it = tables.constBegin(); it != tables.constEnd(); ++it)
+    {
+        for (int kind=0; kind<4; ++kind)
+        {
+            if (it.value().queries[kind] != 0)
+                writeSample(rs, QLatin1String("qtorm_queries_total"),
+                            QString("kind=\"%1\",table=\"%2\"").arg(QLatin1String(kind_names[kind]), escapeLabel(it.key())),
+                            QString::number(it.value().queries[kind]));
+        }
+    }
+
+    writeHeader(rs, "qtorm_query_duration_seconds", "histogram", "Time spent in QSqlQuery::exec()");
+
+    for (QMap<QString, TableMetrics>::const_iterator it = tables.constBegin(); it != tables.constEnd(); ++it)
+    {
+        for (int kind=0; kind<4; ++kind)
+        {
+            if (it.value().queries[kind] != 0)
+                writeHistogram(rs, "qtorm_query_duration_seconds",
+                               QString("kind=\"%1\",table=\"%2\"").arg(QLatin1String(kind_names[kind]), escapeLabel(it.key())),
+                               it.value().durations[kind], duration_bounds, seconds);
+        }
+    }
+
+    writeHeader(rs, "qtorm_rows_read_total", "counter", "Rows fetched by SELECT statements");
+
+    for (QMap<QString, TableMetrics>::const_iterator it = tables.constBegin(); it != tables.constEnd(); ++it)
+        writeSample(rs, QLatin1String("qtorm_rows_read_total"), QString("table=\"%1\"").arg(escapeLabel(it.key())),
+                    QString::number(it.value().rows_read));
+
+    writeHeader(rs, "qtorm_rows_written_total", "counter", "Rows inserted, updated or deleted");
+
+    for (QMap<QString, TableMetrics>::const_iterator it = tables.constBegin(); it != tables.constEnd(); ++it)
+        writeSample(rs, QLatin1String("qtorm_rows_written_total"), QString("table=\"%1\"").arg(escapeLabel(it.key())),
+                    QString::number(it.value().rows_written));
+
+    writeHeader(rs, "qtorm_insert_batch_rows", "histogram", "Rows inserted by one statement (saveBatch sizes)");
+
+    for (QMap<QString, TableMetrics>::const_iterator it = tables.constBegin(); it != tables.constEnd(); ++it)
+    {
+        if (it.value().batch_sizes.count != 0)
+            writeHistogram(rs, "qtorm_insert_batch_rows", QString("table=\"%1\"").arg(escapeLabel(it.key())),
+                           it.value().batch_sizes, size_bounds, 1.0);
+    }
+
+    writeHeader(rs, "qtorm_fill_cache_total", "counter", "Foreign key targets loaded on access, one round trip each");
+
+    for (QMap<QString, TableMetrics>::const_iterator it = tables.constBegin(); it != tables.constEnd(); ++it)
+        writeSample(rs, QLatin1String("qtorm_fill_cache_total"), QString("table=\"%1\"").arg(escapeLabel(it.key())),
+                    QString::number(it.value().fill_cache));
+
+    writeHeader(rs, "qtorm_connection_checkout_seconds", "histogram", "Time spent opening the database of a thread");
+    writeHistogram(rs, "qtorm_connection_checkout_seconds", QString(), checkouts, duration_bounds, seconds);
+
+    QByteArray data = rs.toUtf8();
+
+    return (device->write(data) == data.size());
+}
@@ -0,0 +1,53 @@
+/*
+ * qtormmetrics.h
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef __QTORMMETRICS_H__
+#define __QTORMMETRICS_H__
+
+#include "qtorminstrumentation.h"
+
+class QIODevice;
+
+/*
+ * Counters and latency histograms of the ORM, fed by the instrumentation
+ * events once the registry is installed with QtOrmInstrumentation::install().
+ *
+ * Every thread counts in its own block with relaxed atomic additions, the
+ * blocks are only merged by write(), that renders them in the Prometheus text
+ * exposition format. The block of a thread is merged into a common one and
+ * freed when the thread exits, so its counts are never lost.
+ */
+class QtOrmMetrics : public QtOrmInstrumentation
+{
+    public:
+        static QtOrmMetrics *global();
+
+        void event(const Event &event);
+
+        bool write(QIODevice *device) const;    /*!< @brief Write all the metrics, merged, in Prometheus text format */
+
+    private:
+        QtOrmMetrics();
+        ~QtOrmMetrics();
+};
+
+#endif
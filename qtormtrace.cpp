@@ -0,0 +1,298 @@
+/*
+ * qtormtrace.cpp
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "qtormtrace.h"
+
+#include <QIODevice>
+#include <QFile>
+#include <QCoreApplication>
+#include <QtDebug>
+
+#if defined(Q_OS_LINUX)
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+static const char *kind_names[] = {"select", "insert", "update", "delete"};
+
+static qint64 currentThreadTid()
+{
+#if defined(Q_OS_LINUX)
+    // Same ids as the ones of the system, and of other traces
+    static __thread qint64 tid = 0;
+
+    if (!tid)
+        tid = syscall(SYS_gettid);
+
+    return tid;
+#else
+    static int last_tid = 0;
+    static __thread qint64 tid = 0;
+
+    if (!tid)
+        tid = __atomic_add_fetch(&last_tid, 1, __ATOMIC_RELAXED);
+
+    return tid;
+#endif
+}
+
+static QString jsonString(const QString &value)
+{
+    QString rs;
+
+    rs.reserve(value.size() + 2);
+    rs += QLatin1Char('"');
+
+    for (int i=0; i<value.size(); ++i)
+    {
+        QChar c = value.at(i);
+
+        if (c == QLatin1Char('"') || c == QLatin1Char('\\'))
+        {
+            rs += QLatin1Char('\\');
+            rs += c;
+        }
+        else if (c.unicode() < 0x20)
+        {
+            rs += QString("\\u%1").arg(c.unicode(), 4, 16, QLatin1Char('0'));
+        }
+        else
+        {
+            rs += c;
+        }
+    }
+
+    rs += QLatin1Char('"');
+
+    return rs;
+}
+
+QtOrmTrace::QtOrmTrace(int capacity)
+ : _spans(qMax(capacity, 1)), _first(0), _count(0), _dropped(0)
+{
+}
+
+QtOrmTrace::~QtOrmTrace()
+{
+}
+
+void QtOrmTrace::append(const Span &span)
+{
+    int index = (_first + _count) % _spans.size();
+
+    if (_count == _spans.size())
+    {
+        // Full, overwrite the oldest span
+        _first = (_first + 1) % _spans.size();
+        _dropped++;
+    }
+    else
+    {
+        _count++;
+    }
+
+    _spans[index] = span;
+}
+
+void QtOrmTrace::closeWindows(qint64 tid)
+{
+    for (int decode=0; decode<2; ++decode)
+    {
+        QHash<qint64, Span>::iterator it = _windows.find(tid * 2 + decode);
+
+        if (it != _windows.end())
+        {
+            append(it.value());
+            _windows.erase(it);
+        }
+    }
+}
+
+void QtOrmTrace::event(const Event &event)
+{
+    qint64 tid = currentThreadTid();
+    QMutexLocker locker(&_mutex);
+
+    if (event.phase != Fetch && event.phase != Decode)
+    {
+        closeWindows(tid);
+
+        Span span;
+
+        span.event = event;
+        span.tid = tid;
+        span.events = 1;
+        span.busy = event.end - event.start;
+
+        append(span);
+        return;
+    }
+
+    // One row, extends the window of its statement
+    qint64 key = tid * 2 + (event.phase == Decode ? 1 : 0);
+    QHash<qint64, Span>::iterator it = _windows.find(key);
+
+    if (it != _windows.end())
+    {
+        Span &window = it.value();
+
+        if (window.events < WindowEvents &&
+            window.event.shape == event.shape &&
+            window.event.table == event.table)
+        {
+            window.event.end = event.end;
+            window.event.bytes += event.bytes;
+            window.events++;
+            window.busy += event.end - event.start;
+
+            if (event.rows >= 0)
+                window.event.rows = qMax(window.event.rows, 0) + event.rows;
+
+            return;
+        }
+
+        append(window);
+        _windows.erase(it);
+    }
+
+    Span window;
+
+    window.event = event;
+    window.tid = tid;
+    window.events = 1;
+    window.busy = event.end - event.start;
+
+    _windows.insert(key, window);
+}
+
+int QtOrmTrace::count() const
+{
+    QMutexLocker locker(&_mutex);
+
+    return _count + _windows.count();
+}
+
+qint64 QtOrmTrace::dropped() const
+{
+    QMutexLocker locker(&_mutex);
+
+    return _dropped;
+}
+
+void QtOrmTrace::clear()
+{
+    QMutexLocker locker(&_mutex);
+
+    for (int i=0; i<_spans.size(); ++i)
+        _spans[i].event = Event();
+
+    _windows.clear();
+    _first = 0;
+    _count = 0;
+    _dropped = 0;
+}
+
+bool QtOrmTrace::flush(QIODevice *device)
+{
+    QVector<Span> spans;
+
+    // Take the spans, the other threads go on recording during the write
+    _mutex.lock();
+
+    for (QHash<qint64, Span>::const_iterator it = _windows.constBegin(); it != _windows.constEnd(); ++it)
+        append(it.value());
+
+    _windows.clear();
+    spans.reserve(_count);
+
+    for (int i=0; i<_count; ++i)
+    {
+        Span &span = _spans[(_first + i) % _spans.size()];
+
+        spans.append(span);
+        span.event = Event();
+    }
+
+    _first = 0;
+    _count = 0;
+    _dropped = 0;
+    _mutex.unlock();
+
+    qint64 origin = clockOrigin();
+    qint64 pid = QCoreApplication::applicationPid();
+    QString rs = QLatin1String("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    for (int i=0; i<spans.count(); ++i)
+    {
+        const Span &span = spans.at(i);
+        const Event &event = span.event;
+        QString name = QLatin1String(phaseName(event.phase));
+
+        if (!event.table.isEmpty())
+            name += QLatin1Char(' ') + event.table;
+
+        // Complete events, in microseconds
+        rs += QString("{\"name\":%1,\"cat\":\"qtorm\",\"ph\":\"X\",\"ts\":%2,\"dur\":%3,\"pid\":%4,\"tid\":%5,\"args\":{")
+            .arg(jsonString(name))
+            .arg(QString::number(double(origin + event.start) / 1000.0, 'f', 3))
+            .arg(QString::number(double(event.end - event.start) / 1000.0, 'f', 3))
+            .arg(pid)
+            .arg(span.tid);
+
+        rs += QString("\"kind\":\"%1\"").arg(QLatin1String(kind_names[event.kind]));
+
+        if (!event.shape.isEmpty())
+            rs += (event.phase == Call ? QLatin1String(",\"call\":") : QLatin1String(",\"sql\":")) + jsonString(event.shape);
+
+        if (event.rows >= 0)
+            rs += QString(",\"rows\":%1").arg(event.rows);
+
+        if (event.bytes != 0)
+            rs += QString(",\"bytes\":%1").arg(event.bytes);
+
+        if (span.events > 1)
+            rs += QString(",\"events\":%1,\"busy_us\":%2")
+                .arg(span.events)
+                .arg(QString::number(double(span.busy) / 1000.0, 'f', 3));
+
+        rs += (i == spans.count() - 1 ? QLatin1String("}}\n") : QLatin1String("}},\n"));
+    }
+
+    rs += QLatin1String("]}\n");
+
+    QByteArray data = rs.toUtf8();
+
+    return (device->write(data) == data.size());
+}
+
+bool QtOrmTrace::flush(const QString &fileName)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qDebug() << "Could not open the trace file" << fileName << ":" << file.errorString();
+        return false;
+    }
+
+    return flush(&file);
+}
@@ -0,0 +1,90 @@
+/*
+ * qtormtrace.h
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef __QTORMTRACE_H__
+#define __QTORMTRACE_H__
+
+#include "qtorminstrumentation.h"
+
+#include <QVector>
+#include <QHash>
+
+class QIODevice;
+
+/*
+ * Records the instrumentation events as spans, in a ring buffer of a fixed
+ * number of spans, the oldest ones being overwritten. flush() writes them in
+ * the Chrome trace event JSON format, that Perfetto and chrome://tracing open.
+ *
+ * The timestamps are read from the monotonic clock of the system, so that
+ * the spans line up with the ones of other traces of the same machine. The
+ * spans of a thread nest by time: a QModel::save() contains its statements,
+ * the fill of a foreign key contains its SELECT.
+ *
+ * Fetch and Decode are recorded once per row, so they are coalesced into one
+ * span per window of rows: the consecutive rows of a statement, on a thread,
+ * up to WindowEvents of them. Such a span goes from the start of its first
+ * row to the end of its last one, and gives the number of rows, the summed
+ * bytes and the time really spent in the rows. Any other event of the thread
+ * closes its windows.
+ */
+class QtOrmTrace : public QtOrmInstrumentation
+{
+    public:
+        QtOrmTrace(int capacity = 65536);     /*!< @brief Number of spans kept */
+        ~QtOrmTrace();
+
+        void event(const Event &event);
+
+        int count() const;
+        qint64 dropped() const;                 /*!< @brief Spans overwritten since the last flush */
+        void clear();
+
+        bool flush(QIODevice *device);          /*!< @brief Write the spans as JSON, then empty the buffer */
+        bool flush(const QString &fileName);
+
+        enum
+        {
+            WindowEvents = 100                  /*!< @brief Rows coalesced in a Fetch or Decode span */
+        };
+
+    private:
+        struct Span
+        {
+            Event event;
+            qint64 tid;
+            int events;                         /*!< @brief Events coalesced in the span */
+            qint64 busy;                        /*!< @brief Sum of their durations */
+        };
+
+        void append(const Span &span);
+        void closeWindows(qint64 tid);
+
+        mutable QMutex _mutex;
+        QVector<Span> _spans;
+        QHash<qint64, Span> _windows;           /*!< @brief Open windows, by tid * 2 + (phase == Decode) */
+        int _first;
+        int _count;
+        qint64 _dropped;
+};
+
+#endif
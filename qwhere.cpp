@@ -21,7 +21,10 @@
  */
 
 #include "qwhere.h"
+#include "qwhere_p.h"
 #include "qfield.h"
+#include "qsqlwriter_p.h"
+#include "qnodepool_p.h"
 
 #include <QtDebug>
 #include <QSqlDriver>
@@ -30,32 +33,23 @@
  * QWhere
  */
 
-class QWherePrivate
+QWherePrivate::QWherePrivate(QWhere::Condition cond) : _cond(cond), _refcount(1)
 {
-    public:
-        QWherePrivate(QWhere::Condition cond);
-        virtual ~QWherePrivate();
-
-        QWhere::Condition condition() const;
-        QString fieldName(const QField &field, QSqlDriver *driver) const;
-
-        void ref();
-        bool deref();
-
-        virtual QString sql(QSqlDriver *driver) const = 0;
-        virtual void bindValues(QVariantList &values) const = 0;
+}
 
-    private:
-        QWhere::Condition _cond;
-        unsigned int _refcount;
-};
+QWherePrivate::~QWherePrivate()
+{
+}
 
-QWherePrivate::QWherePrivate(QWhere::Condition cond) : _cond(cond), _refcount(1)
+void *QWherePrivate::operator new(size_t size)
 {
+    // Nodes are small and short-lived, take them from the node pool
+    return QNodePool::allocate(size);
 }
 
-QWherePrivate::~QWherePrivate()
+void QWherePrivate::operator delete(void *ptr, size_t size)
 {
+    QNodePool::release(ptr, size);
 }
 
 QWhere::Condition QWherePrivate::condition() const
@@ -75,9 +69,205 @@ bool QWherePrivate::deref()
     return (_refcount != 0);
 }
 
-QString QWherePrivate::fieldName(const QField &field, QSqlDriver *driver) const
+bool QWherePrivate::equals(const QWherePrivate *other) const
+{
+    return (this == other);
+}
+
+bool QWherePrivate::operands(QWhere::Condition cond, QList<QWhere> &list) const
+{
+    Q_UNUSED(cond);
+    Q_UNUSED(list);
+
+    return false;
+}
+
+bool QWherePrivate::fieldValues(QField &field, QVariantList &values) const
+{
+    Q_UNUSED(field);
+    Q_UNUSED(values);
+
+    return false;
+}
+
+QWhere QWherePrivate::simplified(const QWhere &self) const
+{
+    return self;
+}
+
+QWherePrivate *QWherePrivate::dptr(const QWhere &where)
+{
+    return where.d;
+}
+
+static bool sameValue(const QVariant &a, const QVariant &b)
+{
+    // Values of different types are compared by the database, not here
+    return (!a.isNull() && a.userType() == b.userType() && a == b);
+}
+
+// Values compared the same way here and by the database, whatever the
+// collation. Strings may be equal in the database and not here.
+static bool comparableType(const QVariant &value)
 {
-    return driver->escapeIdentifier(field.fieldName(), QSqlDriver::FieldName);
+    switch (value.type())
+    {
+        case QVariant::Bool:
+        case QVariant::Int:
+        case QVariant::UInt:
+        case QVariant::LongLong:
+        case QVariant::ULongLong:
+        case QVariant::Double:
+        case QVariant::Date:
+        case QVariant::Time:
+        case QVariant::DateTime:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool disjoint(const QVariantList &a, const QVariantList &b)
+{
+    for (int i=0; i<a.count(); ++i)
+    {
+        if (!comparableType(a.at(i)))
+            return false;
+
+        for (int j=0; j<b.count(); ++j)
+        {
+            if (a.at(i).userType() != b.at(j).userType() || a.at(i) == b.at(j))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static void addOperand(QList<QWhere> &list, const QWhere &where)
+{
+    for (int i=0; i<list.count(); ++i)
+    {
+        if (QWherePrivate::dptr(list.at(i))->equals(QWherePrivate::dptr(where)))
+            return;
+    }
+
+    list.append(where);
+}
+
+QWhere QWherePrivate::combine(const QList<QWhere> &input, QWhere::Condition cond)
+{
+    QList<QWhere> operands;
+
+    // Simplify the operands, flatten the nested operators of the same kind and
+    // drop the duplicates. An invalid QWhere is always true.
+    for (int i=0; i<input.count(); ++i)
+    {
+        QWhere where = input.at(i).simplified();
+        QList<QWhere> nested;
+
+        if (!where.isValid())
+        {
+            if (cond == QWhere::Or)
+                return QWhere();
+
+            continue;
+        }
+
+        if (where.isFalse())
+        {
+            if (cond == QWhere::And)
+                return QFalseWhere();
+
+            continue;
+        }
+
+        if (where.d->operands(cond, nested))
+        {
+            for (int j=0; j<nested.count(); ++j)
+                addOperand(operands, nested.at(j));
+        }
+        else
+        {
+            addOperand(operands, where);
+        }
+    }
+
+    if (cond == QWhere::And)
+    {
+        // A field cannot be equal to two disjoint sets of values
+        for (int i=0; i<operands.count(); ++i)
+        {
+            QField f;
+            QVariantList values;
+
+            if (!operands.at(i).d->fieldValues(f, values))
+                continue;
+
+            for (int j=i + 1; j<operands.count(); ++j)
+            {
+                QField other_f;
+                QVariantList other_values;
+
+                if (operands.at(j).d->fieldValues(other_f, other_values) &&
+                    f == other_f && disjoint(values, other_values))
+                {
+                    return QFalseWhere();
+                }
+            }
+        }
+
+        if (operands.count() == 0)
+            return QWhere();
+    }
+    else
+    {
+        // Merge the equalities on the same field in one IN
+        for (int i=0; i<operands.count(); ++i)
+        {
+            QField f;
+            QVariantList values;
+            bool merged = false;
+
+            if (!operands.at(i).d->fieldValues(f, values))
+                continue;
+
+            for (int j=i + 1; j<operands.count(); ++j)
+            {
+                QField other_f;
+                QVariantList other_values;
+
+                if (!operands.at(j).d->fieldValues(other_f, other_values) || !(f == other_f))
+                    continue;
+
+                for (int k=0; k<other_values.count(); ++k)
+                {
+                    bool found = false;
+
+                    for (int l=0; l<values.count() && !found; ++l)
+                        found = sameValue(values.at(l), other_values.at(k));
+
+                    if (!found)
+                        values.append(other_values.at(k));
+                }
+
+                operands.removeAt(j);
+                merged = true;
+                --j;
+            }
+
+            if (merged)
+                operands[i] = QFInWhere(f, values);
+        }
+
+        if (operands.count() == 0)
+            return QFalseWhere();
+    }
+
+    if (operands.count() == 1)
+        return operands.at(0);
+
+    return QListWhere(operands, cond);
 }
 
 QWhere::QWhere() : d(NULL)
@@ -86,7 +276,8 @@ QWhere::QWhere() : d(NULL)
 
 QWhere::QWhere(const QWhere &other) : d(other.d)
 {
-    d->ref();
+    if (d)
+        d->ref();
 }
 
 QWhere::QWhere(QWherePrivate *d) : d(d)
@@ -104,6 +295,19 @@ bool QWhere::isValid() const
     return (d != NULL);
 }
 
+bool QWhere::isFalse() const
+{
+    return (d && d->condition() == AlwaysFalse);
+}
+
+QWhere QWhere::simplified() const
+{
+    if (!d)
+        return *this;
+
+    return d->simplified(*this);
+}
+
 QWhere QWhere::operator!() const
 {
     return QWWhere(*this, Not);
@@ -160,6 +364,8 @@ QString QWhere::conditionStr(QWhere::Condition cond)
             return QLatin1String("NOT ");
         case Like:
             return QLatin1String(" LIKE ");
+        case AlwaysFalse:
+            return QLatin1String("1 = 0");
     }
 
     return QString();
@@ -167,12 +373,24 @@ QString QWhere::conditionStr(QWhere::Condition cond)
 
 QString QWhere::sql(QSqlDriver *driver) const
 {
-    return d->sql(driver);
+    QSqlWriter writer(driver);
+
+    d->writeSql(writer);
+
+    return writer.sql();
 }
 
 void QWhere::bindValues(QVariantList &values) const
 {
-    d->bindValues(values);
+    QSqlWriter writer(NULL);
+
+    d->writeSql(writer);
+    values += writer.values();
+}
+
+void QWhere::writeSql(QSqlWriter &writer) const
+{
+    d->writeSql(writer);
 }
 
 /*
@@ -185,8 +403,10 @@ class QFInWherePrivate : public QWherePrivate
         QFInWherePrivate(const QField &left, const QVariantList &right);
         ~QFInWherePrivate();
 
-        QString sql(QSqlDriver *driver) const;
-        void bindValues(QVariantList &values) const;
+        void writeSql(QSqlWriter &writer) const;
+        bool equals(const QWherePrivate *other) const;
+        bool fieldValues(QField &field, QVariantList &values) const;
+        QWhere simplified(const QWhere &self) const;
 
     private:
         QField _f;
@@ -202,28 +422,40 @@ QFInWherePrivate::~QFInWherePrivate()
 {
 }
 
-QString QFInWherePrivate::sql(QSqlDriver *driver) const
+void QFInWherePrivate::writeSql(QSqlWriter &writer) const
 {
-    QString rs(fieldName(_f, driver));
+    // The writer chooses how to pass the list, depending on its size and the database
+    writer.appendIn(_f, _list);
+}
 
-    rs += QWhere::conditionStr(QWhere::In) + QLatin1String("(");
+bool QFInWherePrivate::equals(const QWherePrivate *other) const
+{
+    const QFInWherePrivate *o = dynamic_cast<const QFInWherePrivate *>(other);
 
+    return (o && o->_f == _f && o->_list == _list);
+}
+
+bool QFInWherePrivate::fieldValues(QField &field, QVariantList &values) const
+{
     for (int i=0; i<_list.count(); ++i)
     {
-        if (i != 0)
-            rs += QLatin1String(", ");
-
-        rs += '?';
+        if (_list.at(i).isNull())
+            return false;
     }
 
-    rs += QLatin1String(")");
+    field = _f;
+    values = _list;
 
-    return rs;
+    return true;
 }
 
-void QFInWherePrivate::bindValues(QVariantList &values) const
+QWhere QFInWherePrivate::simplified(const QWhere &self) const
 {
-    values << _list;
+    // Nothing is in an empty list
+    if (_list.isEmpty())
+        return QFalseWhere();
+
+    return self;
 }
 
 QFInWhere::QFInWhere(const QField &left, const QVariantList &right)
@@ -240,8 +472,8 @@ class QFLikeWherePrivate : public QWherePrivate
         QFLikeWherePrivate(const QField &left, const QString &right);
         ~QFLikeWherePrivate();
 
-        QString sql(QSqlDriver *driver) const;
-        void bindValues(QVariantList &values) const;
+        void writeSql(QSqlWriter &writer) const;
+        bool equals(const QWherePrivate *other) const;
 
     private:
         QField _f;
@@ -257,18 +489,18 @@ QFLikeWherePrivate::~QFLikeWherePrivate()
 {
 }
 
-QString QFLikeWherePrivate::sql(QSqlDriver *driver) const
+void QFLikeWherePrivate::writeSql(QSqlWriter &writer) const
 {
-    QString rs(fieldName(_f, driver));
-
-    rs += QWhere::conditionStr(QWhere::Like) + QLatin1String("?");
-
-    return rs;
+    writer.appendFieldName(_f);
+    writer << QWhere::conditionStr(QWhere::Like);
+    writer.appendValue(_pattern);
 }
 
-void QFLikeWherePrivate::bindValues(QVariantList &values) const
+bool QFLikeWherePrivate::equals(const QWherePrivate *other) const
 {
-    values.append(_pattern);
+    const QFLikeWherePrivate *o = dynamic_cast<const QFLikeWherePrivate *>(other);
+
+    return (o && o->_f == _f && o->_pattern == _pattern);
 }
 
 QFLikeWhere::QFLikeWhere(const QField &left, const QString &right)
@@ -286,8 +518,8 @@ class QFDivWherePrivate : public QWherePrivate
         QFDivWherePrivate(const QField &left, int divisor, int offset);
         ~QFDivWherePrivate();
 
-        QString sql(QSqlDriver *driver) const;
-        void bindValues(QVariantList &values) const;
+        void writeSql(QSqlWriter &writer) const;
+        bool equals(const QWherePrivate *other) const;
 
     private:
         QField _f;
@@ -304,15 +536,22 @@ QFDivWherePrivate::~QFDivWherePrivate()
 {
 }
 
-QString QFDivWherePrivate::sql(QSqlDriver *driver) const
+void QFDivWherePrivate::writeSql(QSqlWriter &writer) const
 {
-    return QString("((%1 + ?) % ? = 0)").arg(fieldName(_f, driver));
+    writer << "((";
+    writer.appendFieldName(_f);
+    writer << " + ";
+    writer.appendValue(_offset);
+    writer << ") % ";
+    writer.appendValue(_divisor);
+    writer << " = 0)";
 }
 
-void QFDivWherePrivate::bindValues(QVariantList &values) const
+bool QFDivWherePrivate::equals(const QWherePrivate *other) const
 {
-    values.append(_offset);
-    values.append(_divisor);
+    const QFDivWherePrivate *o = dynamic_cast<const QFDivWherePrivate *>(other);
+
+    return (o && o->_f == _f && o->_divisor == _divisor && o->_offset == _offset);
 }
 
 QFDivWhere::QFDivWhere(const QField &left, int divisor, int offset)
@@ -329,8 +568,8 @@ class QFFlagSetWherePrivate : public QWherePrivate
         QFFlagSetWherePrivate(const QField &left, int flag);
         ~QFFlagSetWherePrivate();
 
-        QString sql(QSqlDriver *driver) const;
-        void bindValues(QVariantList &values) const;
+        void writeSql(QSqlWriter &writer) const;
+        bool equals(const QWherePrivate *other) const;
 
     private:
         QField _f;
@@ -346,14 +585,20 @@ QFFlagSetWherePrivate::~QFFlagSetWherePrivate()
 {
 }
 
-QString QFFlagSetWherePrivate::sql(QSqlDriver *driver) const
+void QFFlagSetWherePrivate::writeSql(QSqlWriter &writer) const
 {
-    return QString("((%1 & ?) != 0)").arg(fieldName(_f, driver));
+    writer << "((";
+    writer.appendFieldName(_f);
+    writer << " & ";
+    writer.appendValue(_flag);
+    writer << ") != 0)";
 }
 
-void QFFlagSetWherePrivate::bindValues(QVariantList &values) const
+bool QFFlagSetWherePrivate::equals(const QWherePrivate *other) const
 {
-    values.append(_flag);
+    const QFFlagSetWherePrivate *o = dynamic_cast<const QFFlagSetWherePrivate *>(other);
+
+    return (o && o->_f == _f && o->_flag == _flag);
 }
 
 QFFlagSetWhere::QFFlagSetWhere(const QField &left, int flag)
@@ -370,8 +615,8 @@ class QFNullWherePrivate : public QWherePrivate
         QFNullWherePrivate(const QField &left);
         ~QFNullWherePrivate();
 
-        QString sql(QSqlDriver *driver) const;
-        void bindValues(QVariantList &values) const;
+        void writeSql(QSqlWriter &writer) const;
+        bool equals(const QWherePrivate *other) const;
 
     private:
         QField _f;
@@ -386,14 +631,17 @@ QFNullWherePrivate::~QFNullWherePrivate()
 {
 }
 
-QString QFNullWherePrivate::sql(QSqlDriver *driver) const
+void QFNullWherePrivate::writeSql(QSqlWriter &writer) const
 {
-    return QString("%1 IS NULL").arg(fieldName(_f, driver));
+    writer.appendFieldName(_f);
+    writer << " IS NULL";
 }
 
-void QFNullWherePrivate::bindValues(QVariantList &values) const
+bool QFNullWherePrivate::equals(const QWherePrivate *other) const
 {
-    (void) values;
+    const QFNullWherePrivate *o = dynamic_cast<const QFNullWherePrivate *>(other);
+
+    return (o && o->_f == _f);
 }
 
 QFNullWhere::QFNullWhere(const QField &left)
@@ -411,8 +659,9 @@ class QFIWherePrivate : public QWherePrivate
         QFIWherePrivate(const QField &left, const QVariant &right, QWhere::Condition cond);
         ~QFIWherePrivate();
 
-        QString sql(QSqlDriver *driver) const;
-        void bindValues(QVariantList &values) const;
+        void writeSql(QSqlWriter &writer) const;
+        bool equals(const QWherePrivate *other) const;
+        bool fieldValues(QField &field, QVariantList &values) const;
 
     private:
         QField _f;
@@ -428,19 +677,30 @@ QFIWherePrivate::~QFIWherePrivate()
 {
 }
 
-QString QFIWherePrivate::sql(QSqlDriver *driver) const
+void QFIWherePrivate::writeSql(QSqlWriter &writer) const
 {
-    QString rs(fieldName(_f, driver));
+    writer.appendFieldName(_f);
+    writer << QWhere::conditionStr(condition());
+    writer.appendValue(_value);
+}
 
-    rs += QWhere::conditionStr(condition());
-    rs += QLatin1String("?");
+bool QFIWherePrivate::equals(const QWherePrivate *other) const
+{
+    const QFIWherePrivate *o = dynamic_cast<const QFIWherePrivate *>(other);
 
-    return rs;
+    return (o && o->condition() == condition() && o->_f == _f && sameValue(o->_value, _value));
 }
 
-void QFIWherePrivate::bindValues(QVariantList &values) const
+bool QFIWherePrivate::fieldValues(QField &field, QVariantList &values) const
 {
+    if (condition() != QWhere::Equal || _value.isNull())
+        return false;
+
+    field = _f;
+    values.clear();
     values.append(_value);
+
+    return true;
 }
 
 QFIWhere::QFIWhere(const QField &left, const QVariant &right, Condition cond)
@@ -458,8 +718,8 @@ class QFFWherePrivate : public QWherePrivate
         QFFWherePrivate(const QField &left, const QField &right, QWhere::Condition cond);
         ~QFFWherePrivate();
 
-        QString sql(QSqlDriver *driver) const;
-        void bindValues(QVariantList &values) const;
+        void writeSql(QSqlWriter &writer) const;
+        bool equals(const QWherePrivate *other) const;
 
     private:
         QField _left;
@@ -475,20 +735,18 @@ QFFWherePrivate::~QFFWherePrivate()
 {
 }
 
-QString QFFWherePrivate::sql(QSqlDriver *driver) const
+void QFFWherePrivate::writeSql(QSqlWriter &writer) const
 {
-    QString rs(fieldName(_left, driver));
-
-    rs += QWhere::conditionStr(condition());
-    rs += fieldName(_right, driver);
-
-    return rs;
+    writer.appendFieldName(_left);
+    writer << QWhere::conditionStr(condition());
+    writer.appendFieldName(_right);
 }
 
-void QFFWherePrivate::bindValues(QVariantList &values) const
+bool QFFWherePrivate::equals(const QWherePrivate *other) const
 {
-    (void) values;
-    return;
+    const QFFWherePrivate *o = dynamic_cast<const QFFWherePrivate *>(other);
+
+    return (o && o->condition() == condition() && o->_left == _left && o->_right == _right);
 }
 
 QFFWhere::QFFWhere(const QField &left, const QField &right, Condition cond)
@@ -506,8 +764,10 @@ class QWWWherePrivate : public QWherePrivate
         QWWWherePrivate(const QWhere &left, const QWhere &right, QWhere::Condition cond);
         ~QWWWherePrivate();
 
-        QString sql(QSqlDriver *driver) const;
-        void bindValues(QVariantList &values) const;
+        void writeSql(QSqlWriter &writer) const;
+        bool equals(const QWherePrivate *other) const;
+        bool operands(QWhere::Condition cond, QList<QWhere> &list) const;
+        QWhere simplified(const QWhere &self) const;
 
     private:
         QWhere _left;
@@ -523,24 +783,42 @@ QWWWherePrivate::~QWWWherePrivate()
 {
 }
 
-QString QWWWherePrivate::sql(QSqlDriver *driver) const
+void QWWWherePrivate::writeSql(QSqlWriter &writer) const
 {
-    QString rs('(');
+    writer << '(';
+    _left.writeSql(writer);
+    writer << ')' << QWhere::conditionStr(condition()) << '(';
+    _right.writeSql(writer);
+    writer << ')';
+}
 
-    rs += _left.sql(driver);
-    rs += ')';
-    rs += QWhere::conditionStr(condition());
-    rs += '(';
-    rs += _right.sql(driver);
-    rs += ')';
+bool QWWWherePrivate::equals(const QWherePrivate *other) const
+{
+    const QWWWherePrivate *o = dynamic_cast<const QWWWherePrivate *>(other);
 
-    return rs;
+    return (o && o->condition() == condition() &&
+            dptr(o->_left)->equals(dptr(_left)) && dptr(o->_right)->equals(dptr(_right)));
 }
 
-void QWWWherePrivate::bindValues(QVariantList &values) const
+bool QWWWherePrivate::operands(QWhere::Condition cond, QList<QWhere> &list) const
 {
-    _left.bindValues(values);
-    _right.bindValues(values);
+    if (cond != condition())
+        return false;
+
+    list.append(_left);
+    list.append(_right);
+
+    return true;
+}
+
+QWhere QWWWherePrivate::simplified(const QWhere &self) const
+{
+    QList<QWhere> list;
+
+    Q_UNUSED(self);
+    operands(condition(), list);
+
+    return combine(list, condition());
 }
 
 QWWWhere::QWWWhere(const QWhere &left, const QWhere &right, Condition cond)
@@ -548,6 +826,131 @@ QWWWhere::QWWWhere(const QWhere &left, const QWhere &right, Condition cond)
 {
 }
 
+/*
+ * QListWhere
+ */
+
+class QListWherePrivate : public QWherePrivate
+{
+    public:
+        QListWherePrivate(const QList<QWhere> &operands, QWhere::Condition cond);
+        ~QListWherePrivate();
+
+        void writeSql(QSqlWriter &writer) const;
+        bool equals(const QWherePrivate *other) const;
+        bool operands(QWhere::Condition cond, QList<QWhere> &list) const;
+        QWhere simplified(const QWhere &self) const;
+
+    private:
+        QList<QWhere> _operands;
+};
+
+QListWherePrivate::QListWherePrivate(const QList<QWhere> &operands, QWhere::Condition cond)
+: QWherePrivate(cond), _operands(operands)
+{
+}
+
+QListWherePrivate::~QListWherePrivate()
+{
+}
+
+void QListWherePrivate::writeSql(QSqlWriter &writer) const
+{
+    for (int i=0; i<_operands.count(); ++i)
+    {
+        QWhere::Condition cond = dptr(_operands.at(i))->condition();
+        bool group = (cond == QWhere::And || cond == QWhere::Or);
+
+        if (i != 0)
+            writer << QWhere::conditionStr(condition());
+
+        // Only nested AND and OR need parentheses
+        if (group)
+            writer << '(';
+
+        _operands.at(i).writeSql(writer);
+
+        if (group)
+            writer << ')';
+    }
+}
+
+bool QListWherePrivate::equals(const QWherePrivate *other) const
+{
+    const QListWherePrivate *o = dynamic_cast<const QListWherePrivate *>(other);
+
+    if (!o || o->condition() != condition() || o->_operands.count() != _operands.count())
+        return false;
+
+    for (int i=0; i<_operands.count(); ++i)
+    {
+        if (!dptr(o->_operands.at(i))->equals(dptr(_operands.at(i))))
+            return false;
+    }
+
+    return true;
+}
+
+bool QListWherePrivate::operands(QWhere::Condition cond, QList<QWhere> &list) const
+{
+    if (cond != condition())
+        return false;
+
+    list += _operands;
+
+    return true;
+}
+
+QWhere QListWherePrivate::simplified(const QWhere &self) const
+{
+    Q_UNUSED(self);
+
+    return combine(_operands, condition());
+}
+
+QListWhere::QListWhere(const QList<QWhere> &operands, Condition cond)
+: QWhere(new QListWherePrivate(operands, cond))
+{
+}
+
+/*
+ * QFalseWhere
+ */
+
+class QFalseWherePrivate : public QWherePrivate
+{
+    public:
+        QFalseWherePrivate();
+        ~QFalseWherePrivate();
+
+        void writeSql(QSqlWriter &writer) const;
+        bool equals(const QWherePrivate *other) const;
+};
+
+QFalseWherePrivate::QFalseWherePrivate()
+: QWherePrivate(QWhere::AlwaysFalse)
+{
+}
+
+QFalseWherePrivate::~QFalseWherePrivate()
+{
+}
+
+void QFalseWherePrivate::writeSql(QSqlWriter &writer) const
+{
+    writer << QWhere::conditionStr(QWhere::AlwaysFalse);
+}
+
+bool QFalseWherePrivate::equals(const QWherePrivate *other) const
+{
+    return (other->condition() == QWhere::AlwaysFalse);
+}
+
+QFalseWhere::QFalseWhere()
+: QWhere(new QFalseWherePrivate())
+{
+}
+
 /*
  * QWWhere
  */
@@ -558,8 +961,9 @@ class QWWherePrivate : public QWherePrivate
         QWWherePrivate(const QWhere &w, QWhere::Condition cond);
         ~QWWherePrivate();
 
-        QString sql(QSqlDriver *driver) const;
-        void bindValues(QVariantList &values) const;
+        void writeSql(QSqlWriter &writer) const;
+        bool equals(const QWherePrivate *other) const;
+        QWhere simplified(const QWhere &self) const;
 
     private:
         QWhere _w;
@@ -574,20 +978,33 @@ QWWherePrivate::~QWWherePrivate()
 {
 }
 
-QString QWWherePrivate::sql(QSqlDriver *driver) const
+void QWWherePrivate::writeSql(QSqlWriter &writer) const
 {
-    QString rs(QWhere::conditionStr(condition()));
+    writer << QWhere::conditionStr(condition()) << '(';
+    _w.writeSql(writer);
+    writer << ')';
+}
 
-    rs += '(';
-    rs += _w.sql(driver);
-    rs += ')';
+bool QWWherePrivate::equals(const QWherePrivate *other) const
+{
+    const QWWherePrivate *o = dynamic_cast<const QWWherePrivate *>(other);
 
-    return rs;
+    return (o && o->condition() == condition() && dptr(o->_w)->equals(dptr(_w)));
 }
 
-void QWWherePrivate::bindValues(QVariantList &values) const
+QWhere QWWherePrivate::simplified(const QWhere &self) const
 {
-    _w.bindValues(values);
+    QWhere w = _w.simplified();
+
+    Q_UNUSED(self);
+
+    // NOT of something always true or never true
+    if (!w.isValid())
+        return QFalseWhere();
+    else if (w.isFalse())
+        return QWhere();
+
+    return QWWhere(w, condition());
 }
 
 QWWhere::QWWhere(const QWhere &w, Condition cond)
@@ -605,8 +1022,8 @@ class QFWherePrivate : public QWherePrivate
         QFWherePrivate(const QField &f, QWhere::Condition cond);
         ~QFWherePrivate();
 
-        QString sql(QSqlDriver *driver) const;
-        void bindValues(QVariantList &values) const;
+        void writeSql(QSqlWriter &writer) const;
+        bool equals(const QWherePrivate *other) const;
 
     private:
         QField _f;
@@ -621,19 +1038,17 @@ QFWherePrivate::~QFWherePrivate()
 {
 }
 
-QString QFWherePrivate::sql(QSqlDriver *driver) const
+void QFWherePrivate::writeSql(QSqlWriter &writer) const
 {
-    QString rs(fieldName(_f, driver));
-
-    rs += QWhere::conditionStr(condition());
-
-    return rs;
+    writer.appendFieldName(_f);
+    writer << QWhere::conditionStr(condition());
 }
 
-void QFWherePrivate::bindValues(QVariantList &values) const
+bool QFWherePrivate::equals(const QWherePrivate *other) const
 {
-    (void) values;
-    return;
+    const QFWherePrivate *o = dynamic_cast<const QFWherePrivate *>(other);
+
+    return (o && o->condition() == condition() && o->_f == _f);
 }
 
 QFWhere::QFWhere(const QField &f, Condition cond)
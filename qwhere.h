@@ -27,11 +27,14 @@
 
 class QField;
 class QWherePrivate;
+class QSqlWriter;
 
 class QSqlDriver;
 
 class QWhere
 {
+    friend class QWherePrivate;
+
     public:
         enum Condition
         {
@@ -46,7 +49,8 @@ class QWhere
             And,
             Or,
             Not,
-            Like
+            Like,
+            AlwaysFalse /*!< @brief Never true, the result of a contradiction */
         };
 
     public:
@@ -73,6 +77,8 @@ class QWhere
 #endif
 
         bool isValid() const;
+        bool isFalse() const;
+        QWhere simplified() const;
 
         QWhere operator!() const;
         QWhere operator&&(const QWhere &other) const;
@@ -84,6 +90,7 @@ class QWhere
     public:
         QString sql(QSqlDriver *driver) const;
         void bindValues(QVariantList &values) const;
+        void writeSql(QSqlWriter &writer) const;
 
     private:
         QWherePrivate *d;
@@ -137,6 +144,18 @@ class QWWWhere : public QWhere
         QWWWhere(const QWhere &left, const QWhere &right, Condition cond);
 };
 
+class QListWhere : public QWhere
+{
+    public:
+        QListWhere(const QList<QWhere> &operands, Condition cond);
+};
+
+class QFalseWhere : public QWhere
+{
+    public:
+        QFalseWhere();
+};
+
 class QWWhere : public QWhere
 {
     public:
@@ -0,0 +1,65 @@
+/*
+ * qwhere_p.h
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef __QWHERE_P_H__
+#define __QWHERE_P_H__
+
+#include <cstddef>
+#include <QList>
+#include <QVariant>
+
+#include "qwhere.h"
+
+class QField;
+class QSqlWriter;
+
+class QWherePrivate
+{
+    public:
+        QWherePrivate(QWhere::Condition cond);
+        virtual ~QWherePrivate();
+
+        static void *operator new(size_t size);
+        static void operator delete(void *ptr, size_t size);
+
+        QWhere::Condition condition() const;
+
+        void ref();
+        bool deref();
+
+        virtual void writeSql(QSqlWriter &writer) const = 0;
+
+        // Simplification
+        virtual bool equals(const QWherePrivate *other) const;
+        virtual bool operands(QWhere::Condition cond, QList<QWhere> &list) const;
+        virtual bool fieldValues(QField &field, QVariantList &values) const;
+        virtual QWhere simplified(const QWhere &self) const;
+
+        static QWherePrivate *dptr(const QWhere &where);
+        static QWhere combine(const QList<QWhere> &operands, QWhere::Condition cond);
+
+    private:
+        QWhere::Condition _cond;
+        unsigned int _refcount;
+};
+
+#endif
@@ -0,0 +1,198 @@
+/*
+ * qwhere.cpp
+ * This file is part of QtORM
+ *
+ * Copyright (C) 2012 - Denis Steckelmacher <steckdenis@yahoo.fr>
+ *
+ * QtORM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * QtORM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Logram; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Simplification of the filters: flattening, removal of the duplicates, merge
+ * of the equalities of an OR in one IN, and contradictions of an AND. Only the
+ * rewrites that keep the results of the database are allowed.
+ */
+
+#include "qmodel.h"
+#include "qf.h"
+
+#include <QCoreApplication>
+#include <QSqlDatabase>
+#include <QSqlDriver>
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(bool ok, const char *cond, int line)
+{
+    if (ok)
+        return;
+
+    printf("FAIL line %d: %s\n", line, cond);
+    failures++;
+}
+
+struct Item : public QModel
+{
+    Item() : QModel("test_item")
+    {
+        number = intField("number");
+        name = stringField("name");
+
+        init();
+    }
+
+    QIntField number;
+    QStringField name;
+};
+
+static QVariantList values(const QWhere &where)
+{
+    QVariantList rs;
+
+    where.bindValues(rs);
+
+    return rs;
+}
+
+static void testContradictions(Item &item, QSqlDriver *driver)
+{
+    // a = 1 AND a = 2 is never true
+    QWhere where = (QF(item.number) == 1 && QF(item.number) == 2).simplified();
+
+    CHECK(where.isFalse());
+
+    // The sets of values overlap
+    where = (QF(item.number) == 1 && QF(item.number).in(QVariantList() << 1 << 2)).simplified();
+
+    CHECK(!where.isFalse());
+
+    // Strings may be equal in the database, depending on its collation
+    where = (QF(item.name) == QString("x") && QF(item.name) == QString("X")).simplified();
+
+    CHECK(!where.isFalse());
+    CHECK(where.sql(driver).contains(" AND "));
+    CHECK(values(where) == (QVariantList() << QString("x") << QString("X")));
+
+    // A NULL in the list is compared by the database, not here
+    where = (QF(item.number).in(QVariantList() << 1 << QVariant()) && QF(item.number) == 2).simplified();
+
+    CHECK(!where.isFalse());
+}
+
+static void testMerges(Item &item, QSqlDriver *driver)
+{
+    // Equalities on the same field make one IN
+    QWhere where = (QF(item.number) == 1 || QF(item.number) == 2 || QF(item.number) == 3).simplified();
+    QVariantList list = values(where);
+
+    CHECK(where.sql(driver).contains(" IN "));
+    CHECK(!where.sql(driver).contains(" OR "));
+    CHECK(list == (QVariantList() << 1 << 2 << 3));
+
+    // Duplicates are dropped
+    where = (QF(item.number) == 1 || QF(item.number) == 1).simplified();
+
+    CHECK(values(where) == (QVariantList() << 1));
+
+    // 1 and 1.0 have different types, both are given to the database
+    where = (QF(item.number) == 1 || QF(item.number) == 1.0).simplified();
+    list = values(where);
+
+    CHECK(list.count() == 2);
+    CHECK(list.count() == 2 && list.at(0).type() == QVariant::Int);
+    CHECK(list.count() == 2 && list.at(1).type() == QVariant::Double);
+}
+
+static void testNullMerges(Item &item, QSqlDriver *driver)
+{
+    // An IN containing NULL is not merged with the other equalities
+    QWhere where = (QF(item.number).in(QVariantList() << 1 << QVariant()) || QF(item.number) == 2).simplified();
+    QVariantList list = values(where);
+
+    CHECK(where.sql(driver).contains(" OR "));
+    CHECK(list.count() == 3);
+    CHECK(list.count() == 3 && list.at(1).isNull() && list.at(2) == QVariant(2));
+
+    // Nor an equality with NULL, that no row matches
+    where = (QF(item.number) == QVariant() || QF(item.number) == 1).simplified();
+    list = values(where);
+
+    CHECK(where.sql(driver).contains(" OR "));
+    CHECK(list.count() == 2);
+
+    // A typed NULL neither
+    where = (QF(item.number).in(QVariantList() << 1 << 2) || QF(item.number) == QVariant(QVariant::Int)).simplified();
+    list = values(where);
+
+    CHECK(where.sql(driver).contains(" OR "));
+    CHECK(list.count() == 3);
+}
+
+static void testFlattening(Item &item, QSqlDriver *driver)
+{
+    // Nested ANDs are one list, without the duplicates
+    QWhere name = (QF(item.name) == QString("x"));
+    QWhere where = ((QF(item.number) > 1 && name) && (name && QF(item.number) < 10)).simplified();
+    QString sql = where.sql(driver);
+
+    CHECK(sql.count(" AND ") == 2);
+    CHECK(values(where) == (QVariantList() << 1 << QString("x") << 10));
+
+    // An invalid filter is always true
+    where = (QWhere() && QF(item.number) == 1).simplified();
+
+    CHECK(values(where) == (QVariantList() << 1));
+
+    where = (QWhere() || QF(item.number) == 1).simplified();
+
+    CHECK(!where.isValid());
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
+
+    db.setDatabaseName(":memory:");
+
+    if (!db.open())
+    {
+        printf("Cannot open the SQLite database\n");
+        return 1;
+    }
+
+    Item item;
+
+    testContradictions(item, db.driver());
+    testMerges(item, db.driver());
+    testNullMerges(item, db.driver());
+    testFlattening(item, db.driver());
+
+    if (failures)
+    {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("All checks passed\n");
+
+    return 0;
+}